@@ -3,20 +3,6 @@
 
 #include "ganalytics.h"
 
-class Watcher : public QObject
-{
-    Q_OBJECT
-
-public slots:
-    void onIsSendingChanged(bool sending)
-    {
-        if (sending)
-            return;
-
-        QCoreApplication::instance()->quit();
-    }
-};
-
 int main(int argc, char* argv[])
 {
     QCoreApplication::setOrganizationName("HSAnet");
@@ -28,23 +14,16 @@ int main(int argc, char* argv[])
     // Create the tracker
     GAnalytics tracker("UA-53395376-1");
 
-    Watcher watcher;
-    QObject::connect(&tracker, SIGNAL(isSendingChanged(bool)), &watcher, SLOT(onIsSendingChanged(bool)));
-
-    // Shorten the interval
-    tracker.setSendInterval(5 * 1000);
-
     // Send some dummy events
     tracker.sendEvent("lifecycle", "application_started");
     tracker.sendEvent("lifecycle", "application_stopped");
 
-    qDebug() << "Waiting until the evens were sent ...";
+    qDebug() << "Sending the events ...";
 
-    int ret = app.exec();
+    // Give the tracker at most five seconds, whatever is left is sent on the next start
+    GAnalytics::FlushResult result = tracker.flush(5 * 1000);
 
-    qDebug() << "Shutting down.";
+    qDebug() << "Shutting down." << result.sent << "sent," << result.persisted << "persisted.";
 
-    return ret;
+    return 0;
 }
-
-#include "main.moc"
@@ -0,0 +1,13 @@
+TEMPLATE = app
+QT = core network
+
+CONFIG += console c++11
+CONFIG -= app_bundle
+
+HEADERS += simulatednetwork.h \
+    virtualeventdispatcher.h
+SOURCES += main.cpp \
+    simulatednetwork.cpp \
+    virtualeventdispatcher.cpp
+
+include(../../qt-google-analytics.pri)
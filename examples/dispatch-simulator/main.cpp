@@ -0,0 +1,843 @@
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QRegularExpression>
+#include <QStringList>
+#include <QTextStream>
+#include <QUrlQuery>
+
+#include <algorithm>
+#include <random>
+
+#include "ganalytics_p.h"
+#include "ganalyticsreachability.h"
+#include "simulatednetwork.h"
+#include "virtualeventdispatcher.h"
+
+/**
+ * Dispatch simulator
+ * Replays a hit trace through the real dispatch logic of the tracker,
+ * on a virtual clock and against a simulated collector, once for every
+ * policy given on the command line. Months of traffic take seconds.
+ */
+
+struct Policy
+{
+    QString name;
+    int sendInterval;
+    int burst;
+    double messagesPerSecond;
+    qint64 maxAge;
+    int gzipThreshold;
+    bool adaptive;
+    int minHits;
+    int maxHits;
+    int minPosts;
+    int maxPosts;
+};
+
+struct TraceHit
+{
+    qint64 time;
+    GAnalytics::Priority priority;
+};
+
+struct Scenario
+{
+    QList<TraceHit> trace;
+    qint64 duration;
+    qint64 drain;
+    TransportScript transport;
+    bool visibleOutages;
+    quint32 seed;
+    qint64 controlInterval;     ///< Sampling interval of the adaptive dispatch, 0 for none
+};
+
+/**
+ * State of the adaptive dispatch at one point of a run.
+ */
+struct ControlSample
+{
+    qint64 time;
+    int hitsPerPost;
+    int concurrentPosts;
+    qint64 roundTripTime;
+    double throughput;
+};
+
+struct Result
+{
+    int generated;
+    int delivered;
+    int refused;
+    int left;
+    QList<int> undelivered;     ///< Hits which never arrived
+    QList<int> deadLetters;     ///< Hits in the dead-letter store at the end
+    QVector<qint64> latencies;
+    int peakHeld;
+    int requests;
+    int hitsSent;
+    qint64 bytes;
+    qint64 runTime;
+    QList<ControlSample> control;
+};
+
+/**
+ * Keeps the tracker values of a run in memory.
+ */
+class MemorySettingsStore : public GAnalyticsSettingsStore
+{
+public:
+    QVariantMap load()
+    {
+        return QVariantMap();
+    }
+
+    void save(const QVariantMap &changes)
+    {
+        Q_UNUSED(changes);
+    }
+};
+
+static const qint64 second = 1000;
+static const qint64 minute = 60 * second;
+static const qint64 hour = 60 * minute;
+static const qint64 day = 24 * hour;
+
+/**
+ * Parse a duration like "250ms", "30s", "5m", "4h" or "30d".
+ * A number without unit is taken as milliseconds.
+ * @return milliseconds     -1 if the text is not a duration.
+ */
+static qint64 parseDuration(const QString &text)
+{
+    static const char *units[] = { "ms", "s", "m", "h", "d" };
+    static const qint64 factors[] = { 1, second, minute, hour, day };
+
+    for (int i = 0; i < 5; ++i)
+    {
+        if (text.endsWith(units[i]))
+        {
+            bool ok = false;
+            double value = text.left(text.length() - int(qstrlen(units[i]))).toDouble(&ok);
+            return ok ? qint64(value * factors[i]) : -1;
+        }
+    }
+
+    bool ok = false;
+    qint64 value = text.toLongLong(&ok);
+    return ok ? value : -1;
+}
+
+static QString formatDuration(qint64 milliseconds)
+{
+    if (milliseconds < second)
+    {
+        return QString("%1ms").arg(milliseconds);
+    }
+    if (milliseconds < minute)
+    {
+        return QString("%1s").arg(double(milliseconds) / second, 0, 'f', 1);
+    }
+    if (milliseconds < hour)
+    {
+        return QString("%1m").arg(double(milliseconds) / minute, 0, 'f', 1);
+    }
+    if (milliseconds < day)
+    {
+        return QString("%1h").arg(double(milliseconds) / hour, 0, 'f', 1);
+    }
+    return QString("%1d").arg(double(milliseconds) / day, 0, 'f', 1);
+}
+
+/**
+ * Parse a size like "512", "64k" or "2m" in bytes.
+ * @return bytes        -1 if the text is not a size.
+ */
+static qint64 parseBytes(const QString &text)
+{
+    qint64 factor = 1;
+    QString number = text;
+    if (text.endsWith('k'))
+    {
+        factor = 1024;
+        number.chop(1);
+    }
+    else if (text.endsWith('m'))
+    {
+        factor = 1024 * 1024;
+        number.chop(1);
+    }
+
+    bool ok = false;
+    double value = number.toDouble(&ok);
+    return ok && value >= 0 ? qint64(value * factor) : -1;
+}
+
+/**
+ * Parse a range like "1-20".
+ * @return ok
+ */
+static bool parseRange(const QString &text, int &lower, int &upper)
+{
+    bool lowerOk = false;
+    bool upperOk = false;
+    lower = text.section('-', 0, 0).toInt(&lowerOk);
+    upper = text.section('-', 1).toInt(&upperOk);
+
+    return lowerOk && upperOk && lower > 0 && lower <= upper;
+}
+
+/**
+ * Parse a policy like "interval=30s,burst=20,rate=1,max-age=4h,gzip=1024"
+ * or "adaptive,hits=1-20,posts=1-8".
+ * Missing keys keep the tracker defaults.
+ * @return ok           False on unknown keys or bad values.
+ */
+static bool parsePolicy(const QString &text, Policy &policy)
+{
+    policy.name = text;
+    policy.sendInterval = 30 * second;
+    policy.burst = 0;
+    policy.messagesPerSecond = 0.0;
+    policy.maxAge = GAnalyticsCore::fourHours;
+    policy.gzipThreshold = 0;
+    policy.adaptive = false;
+    policy.minHits = 1;
+    policy.maxHits = GAnalyticsCore::maxHitsPerBatch;
+    policy.minPosts = 1;
+    policy.maxPosts = 8;
+
+    foreach (const QString &item, text.split(','))
+    {
+        if (item.trimmed().isEmpty())
+        {
+            continue;
+        }
+
+        QString key = item.section('=', 0, 0).trimmed();
+        QString value = item.section('=', 1).trimmed();
+        bool ok = true;
+
+        if (key == "interval")
+        {
+            policy.sendInterval = int(parseDuration(value));
+            ok = policy.sendInterval > 0;
+        }
+        else if (key == "burst")
+        {
+            policy.burst = value.toInt(&ok);
+        }
+        else if (key == "rate")
+        {
+            policy.messagesPerSecond = value.toDouble(&ok);
+        }
+        else if (key == "max-age")
+        {
+            policy.maxAge = parseDuration(value);
+            ok = policy.maxAge > 0;
+        }
+        else if (key == "adaptive")
+        {
+            policy.adaptive = value.isEmpty() || value == "1";
+            ok = policy.adaptive || value == "0";
+        }
+        else if (key == "hits")
+        {
+            ok = parseRange(value, policy.minHits, policy.maxHits);
+        }
+        else if (key == "posts")
+        {
+            ok = parseRange(value, policy.minPosts, policy.maxPosts);
+        }
+        else if (key == "gzip")
+        {
+            policy.gzipThreshold = value.toInt(&ok);
+            ok = ok && (policy.gzipThreshold == 0 || GAnalyticsCompressor::isAvailable());
+        }
+        else
+        {
+            ok = false;
+        }
+
+        if (!ok)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Read a recorded trace. Each line holds the time of a hit in
+ * milliseconds since the start and optionally its priority
+ * (urgent, normal or bulk). Lines starting with # are ignored.
+ */
+static bool loadTrace(const QString &fileName, QList<TraceHit> &trace)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        return false;
+    }
+
+    QTextStream in(&file);
+    while (!in.atEnd())
+    {
+        QString line = in.readLine().trimmed();
+        if (line.isEmpty() || line.startsWith('#'))
+        {
+            continue;
+        }
+
+        QStringList fields = line.split(QRegularExpression("[\\s,]+"));
+        TraceHit hit;
+        hit.time = fields.at(0).toLongLong();
+        hit.priority = GAnalytics::Normal;
+        if (fields.count() > 1 && fields.at(1) == "urgent")
+        {
+            hit.priority = GAnalytics::Urgent;
+        }
+        else if (fields.count() > 1 && fields.at(1) == "bulk")
+        {
+            hit.priority = GAnalytics::Bulk;
+        }
+        trace << hit;
+    }
+
+    std::stable_sort(trace.begin(), trace.end(),
+                     [](const TraceHit &a, const TraceHit &b) { return a.time < b.time; });
+    return true;
+}
+
+/**
+ * Hits arriving as a Poisson process.
+ */
+static QList<TraceHit> syntheticTrace(double hitsPerHour, qint64 duration, quint32 seed)
+{
+    QList<TraceHit> trace;
+    if (hitsPerHour <= 0)
+    {
+        return trace;
+    }
+
+    std::mt19937 random(seed);
+    std::exponential_distribution<double> gap(hitsPerHour / hour);
+    for (double time = gap(random); time < duration; time += gap(random))
+    {
+        TraceHit hit;
+        hit.time = qint64(time);
+        hit.priority = GAnalytics::Normal;
+        trace << hit;
+    }
+
+    return trace;
+}
+
+/**
+ * Outages starting as a Poisson process, each of the same length.
+ */
+static QList<QPair<qint64, qint64> > randomOutages(double perDay, qint64 length, qint64 duration, quint32 seed)
+{
+    QList<QPair<qint64, qint64> > outages;
+    if (perDay <= 0 || length <= 0)
+    {
+        return outages;
+    }
+
+    std::mt19937 random(seed ^ 0x9e3779b9u);
+    std::exponential_distribution<double> gap(perDay / day);
+    for (double time = gap(random); time < duration; time += length + gap(random))
+    {
+        outages << qMakePair(qint64(time), qint64(time) + length);
+    }
+
+    return outages;
+}
+
+/**
+ * Messages the tracker holds in memory: queued and in flight.
+ */
+static int heldMessages(GAnalytics::Private *d)
+{
+    int held = d->core.count();
+    foreach (const GAnalyticsCore::Batch &batch, d->inFlight)
+    {
+        held += batch.messages.count();
+    }
+
+    return held;
+}
+
+/**
+ * Run the scenario with a fresh tracker configured by the policy.
+ */
+static Result simulate(const Policy &policy, const Scenario &scenario, VirtualEventDispatcher *dispatcher)
+{
+    QElapsedTimer runTime;
+    runTime.start();
+
+    qint64 origin = dispatcher->elapsed();
+    SimulatedNetwork network(scenario.transport, dispatcher, scenario.seed);
+    QVector<qint64> generated(scenario.trace.count());
+
+    Result result;
+    result.generated = scenario.trace.count();
+    result.peakHeld = 0;
+
+    {
+        GAnalytics tracker("UA-00000000-1");
+        tracker.setSettingsStore(new MemorySettingsStore);
+        GAnalytics::Private *d = GAnalytics::Private::get(&tracker);
+        d->core.setClock(dispatcher);
+        d->core.setMaxMessageAge(policy.maxAge);
+
+        GAnalyticsManualReachability *reachability = new GAnalyticsManualReachability(&tracker);
+        tracker.setReachability(reachability);
+        tracker.setNetworkAccessManager(&network);
+        tracker.setSendInterval(policy.sendInterval);
+        tracker.setRateLimit(policy.burst, policy.messagesPerSecond);
+        tracker.setCompressionThreshold(policy.gzipThreshold);
+        tracker.setAdaptiveDispatch(policy.adaptive);
+        tracker.setDispatchBounds(policy.minHits, policy.maxHits, policy.minPosts, policy.maxPosts);
+
+        // Run the virtual clock, sampling the adaptive dispatch on the way
+        qint64 nextSample = scenario.controlInterval;
+        auto runUntil = [&](qint64 time)
+        {
+            for (; policy.adaptive && nextSample > 0 && nextSample <= time; nextSample += scenario.controlInterval)
+            {
+                dispatcher->runUntil(origin + nextSample);
+                const GAnalyticsCongestionControl &control = d->core.congestionControl();
+                ControlSample sample;
+                sample.time = nextSample;
+                sample.hitsPerPost = control.hitsPerPost();
+                sample.concurrentPosts = control.concurrentPosts();
+                sample.roundTripTime = control.roundTripTime();
+                sample.throughput = control.throughput();
+                result.control << sample;
+            }
+            dispatcher->runUntil(origin + time);
+        };
+
+        // Reachability changes, if the device notices the outages
+        QList<QPair<qint64, bool> > changes;
+        if (scenario.visibleOutages)
+        {
+            foreach (const QPair<qint64, qint64> &outage, scenario.transport.outages)
+            {
+                changes << qMakePair(outage.first, false) << qMakePair(outage.second, true);
+            }
+        }
+
+        int change = 0;
+        for (int i = 0; i < scenario.trace.count(); ++i)
+        {
+            const TraceHit &hit = scenario.trace.at(i);
+            for (; change < changes.count() && changes.at(change).first <= hit.time; ++change)
+            {
+                runUntil(changes.at(change).first);
+                reachability->setOnline(changes.at(change).second);
+            }
+
+            runUntil(hit.time);
+            generated[i] = dispatcher->elapsed();
+            tracker.sendEvent("simulation", "hit", QString(), i, QVariantMap(), hit.priority);
+            result.peakHeld = qMax(result.peakHeld, heldMessages(d));
+        }
+
+        for (; change < changes.count(); ++change)
+        {
+            runUntil(changes.at(change).first);
+            reachability->setOnline(changes.at(change).second);
+        }
+        runUntil(scenario.duration + scenario.drain);
+
+        result.refused = d->core.rejectedCount();
+        result.left = heldMessages(d) + d->core.backlogCount();
+        foreach (const GAnalyticsCore::DeadLetter &letter, d->core.deadLetters())
+        {
+            result.deadLetters << QUrlQuery(letter.message).queryItemValue("ev").toInt();
+        }
+    }
+
+    const QVector<qint64> &arrivals = network.deliveries();
+    for (int i = 0; i < arrivals.count() && i < generated.count(); ++i)
+    {
+        if (arrivals.at(i) >= 0)
+        {
+            result.latencies << arrivals.at(i) - generated.at(i);
+        }
+    }
+    std::sort(result.latencies.begin(), result.latencies.end());
+    for (int i = 0; i < generated.count(); ++i)
+    {
+        if (i >= arrivals.count() || arrivals.at(i) < 0)
+        {
+            result.undelivered << i;
+        }
+    }
+
+    result.delivered = result.latencies.count();
+    result.requests = network.requestCount();
+    result.hitsSent = network.hitsSent();
+    result.bytes = network.bytesSent();
+    result.runTime = runTime.elapsed();
+
+    return result;
+}
+
+/**
+ * Check that the poisoned hits ended up in the dead-letter store
+ * and did not keep any other hit from being delivered.
+ * @return failures     One line per violation, empty if the run passed.
+ */
+static QStringList checkDelivery(const Scenario &scenario, const Result &result)
+{
+    QStringList failures;
+    foreach (int hitID, scenario.transport.poisoned)
+    {
+        if (hitID < result.generated && !result.deadLetters.contains(hitID))
+        {
+            failures << QString("poisoned hit %1 is not in the dead-letter store").arg(hitID);
+        }
+    }
+    foreach (int hitID, result.undelivered)
+    {
+        if (!scenario.transport.poisoned.contains(hitID))
+        {
+            failures << QString("hit %1 was not delivered").arg(hitID);
+        }
+    }
+
+    return failures;
+}
+
+static void reportSize(QTextStream &out, const QString &name, const QByteArray &data)
+{
+    out << "    " << name.leftJustified(18) << QString::number(data.size()).rightJustified(10) << "\n";
+}
+
+/**
+ * Persist the same messages as the string list written before the
+ * paged backlog, once with the date strings stored then and once as
+ * persistMessages() builds it, and as pages with either encoding.
+ * Reports the bytes written per 10000 messages.
+ */
+static void reportPersistence(QTextStream &out)
+{
+    const int hits = 10000;
+
+    GAnalytics tracker("UA-00000000-1");
+    tracker.setSettingsStore(new MemorySettingsStore);
+    for (int i = 0; i < hits; ++i)
+    {
+        tracker.sendEvent("simulation", "hit", QString(), i);
+    }
+    GAnalyticsCore &core = GAnalytics::Private::get(&tracker)->core;
+    const QList<GAnalyticsCore::Message> messages = core.messages();
+
+    out << "bytes persisted per " << hits << " hits\n";
+
+    QList<QString> dated;
+    foreach (const GAnalyticsCore::Message &message, messages)
+    {
+        QDateTime time = QDateTime::fromMSecsSinceEpoch(core.clockAnchor() + message.time);
+        dated << QUrlQuery(QString::fromLatin1(message.query)).toString()
+              << time.toString("yyyy,MM,dd-hh:mm::ss:zzz");
+    }
+    QByteArray data;
+    QDataStream datedStream(&data, QIODevice::WriteOnly);
+    datedStream << dated;
+    reportSize(out, "dated list", data);
+
+    data.clear();
+    QDataStream listStream(&data, QIODevice::WriteOnly);
+    listStream << core.persistMessages(messages);
+    reportSize(out, "list", data);
+
+    for (int compressed = 0; compressed < 2; ++compressed)
+    {
+        data.clear();
+        QDataStream pageStream(&data, QIODevice::WriteOnly);
+        core.setCompressPersistedMessages(compressed);
+        core.writeMessages(pageStream);
+        reportSize(out, compressed ? "compressed pages" : "plain pages", data);
+    }
+}
+
+/**
+ * Compare the cost of stamping a message and computing its queue time
+ * with local date times, as done before the monotonic clock, against
+ * the clock of the core. Reports nanoseconds per message.
+ */
+static void reportStamping(QTextStream &out)
+{
+    const int hits = 100000;
+
+    GAnalyticsCore core;
+    core.setTrackingID("UA-00000000-1");
+    QByteArray query = core.buildEventQuery("simulation", "hit").query(QUrl::FullyEncoded).toUtf8();
+
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < hits; ++i)
+    {
+        QDateTime queued = QDateTime::currentDateTime();
+        queued.msecsTo(QDateTime::currentDateTime());
+    }
+    qint64 dateTimes = timer.nsecsElapsed();
+
+    GAnalyticsCore::Message message;
+    timer.restart();
+    for (int i = 0; i < hits; ++i)
+    {
+        message.time = core.now();
+        GAnalyticsCore::queueTimeField(message, core.now());
+    }
+    qint64 monotonic = timer.nsecsElapsed();
+
+    timer.restart();
+    for (int i = 0; i < hits; ++i)
+    {
+        core.enqueue(query);
+    }
+    qint64 enqueue = timer.nsecsElapsed();
+
+    out << "nanoseconds per hit\n"
+        << "    " << QString("date time").leftJustified(12) << QString::number(dateTimes / hits).rightJustified(10) << "\n"
+        << "    " << QString("monotonic").leftJustified(12) << QString::number(monotonic / hits).rightJustified(10) << "\n"
+        << "    " << QString("enqueue").leftJustified(12) << QString::number(enqueue / hits).rightJustified(10) << "\n";
+}
+
+static QString percentile(const QVector<qint64> &sorted, double fraction)
+{
+    if (sorted.isEmpty())
+    {
+        return "-";
+    }
+
+    int index = qMin(sorted.count() - 1, int(fraction * sorted.count()));
+    return formatDuration(sorted.at(index));
+}
+
+static QString row(const QString &name, const QStringList &columns)
+{
+    QString line = name.leftJustified(36);
+    foreach (const QString &column, columns)
+    {
+        line += column.rightJustified(11);
+    }
+
+    return line + "\n";
+}
+
+int main(int argc, char* argv[])
+{
+    QCoreApplication::setOrganizationName("HSAnet");
+    QCoreApplication::setApplicationName("Dispatch-Simulator");
+    QCoreApplication::setApplicationVersion("0.1");
+
+    // All timers run on virtual time
+    VirtualEventDispatcher *dispatcher = new VirtualEventDispatcher;
+    QCoreApplication::setEventDispatcher(dispatcher);
+
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Replays hit traces through the tracker's dispatch logic "
+                                     "on a virtual clock and reports how each policy performs.");
+    parser.addHelpOption();
+    parser.addOptions(QList<QCommandLineOption>()
+        << QCommandLineOption("policy", "Policy to evaluate, e.g. interval=30s,burst=20,rate=1,max-age=4h,gzip=1024. Repeatable.", "policy")
+        << QCommandLineOption("trace", "Recorded trace: one hit per line, time in ms and optional priority.", "file")
+        << QCommandLineOption("duration", "Length of the synthetic trace.", "duration", "30d")
+        << QCommandLineOption("hits-per-hour", "Rate of the synthetic trace.", "rate", "60")
+        << QCommandLineOption("drain", "Time to keep running after the last hit.", "duration", "1d")
+        << QCommandLineOption("latency", "Round trip time of a request.", "duration", "200ms")
+        << QCommandLineOption("jitter", "Random extra latency.", "duration", "100ms")
+        << QCommandLineOption("bandwidth", "Uplink bytes per second, e.g. 64k. 0 for unlimited.", "bytes", "0")
+        << QCommandLineOption("link", "Change of latency and bandwidth at a time, e.g. 2h:800ms:8k. Repeatable.", "change")
+        << QCommandLineOption("control-log", "Print the state of adaptive policies at this interval.", "duration")
+        << QCommandLineOption("connect-timeout", "Time until a request fails during an outage.", "duration", "10s")
+        << QCommandLineOption("error-rate", "Share of requests failing with 503.", "share", "0.01")
+        << QCommandLineOption("reject-rate", "Share of hits refused with 400.", "share", "0.001")
+        << QCommandLineOption("poison", "Hit the collector always refuses with 400. Repeatable.", "hit")
+        << QCommandLineOption("check", "Fail unless every hit but the poisoned ones is delivered and those are dead-lettered.")
+        << QCommandLineOption("outage", "Outage at start+length, e.g. 3d+12h. Repeatable.", "outage")
+        << QCommandLineOption("outages-per-day", "Rate of random outages.", "rate", "0.5")
+        << QCommandLineOption("outage-length", "Length of random outages.", "duration", "2h")
+        << QCommandLineOption("visible-outages", "The device notices outages and goes offline.")
+        << QCommandLineOption("persistence", "Report the bytes persisted per 10000 hits as the legacy string list and for each page encoding.")
+        << QCommandLineOption("stamping", "Report the time spent per hit on time stamps and enqueueing.")
+        << QCommandLineOption("seed", "Seed for all random choices.", "seed", "1"));
+    parser.process(app);
+
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    if (parser.isSet("persistence"))
+    {
+        reportPersistence(out);
+        return 0;
+    }
+
+    if (parser.isSet("stamping"))
+    {
+        reportStamping(out);
+        return 0;
+    }
+
+    Scenario scenario;
+    scenario.seed = parser.value("seed").toUInt();
+    scenario.duration = parseDuration(parser.value("duration"));
+    scenario.drain = parseDuration(parser.value("drain"));
+    scenario.visibleOutages = parser.isSet("visible-outages");
+    scenario.transport.latency = int(parseDuration(parser.value("latency")));
+    scenario.transport.jitter = int(parseDuration(parser.value("jitter")));
+    scenario.transport.bandwidth = parseBytes(parser.value("bandwidth"));
+    scenario.controlInterval = parser.isSet("control-log") ? parseDuration(parser.value("control-log")) : 0;
+    if (scenario.transport.bandwidth < 0 || scenario.controlInterval < 0)
+    {
+        err << "Bad bandwidth or control log interval\n";
+        return 1;
+    }
+
+    foreach (const QString &text, parser.values("link"))
+    {
+        TransportScript::LinkChange change;
+        change.time = parseDuration(text.section(':', 0, 0));
+        change.latency = int(parseDuration(text.section(':', 1, 1)));
+        change.bandwidth = parseBytes(text.section(':', 2));
+        if (change.time < 0 || change.latency < 0 || change.bandwidth < 0)
+        {
+            err << "Bad link change " << text << "\n";
+            return 1;
+        }
+        scenario.transport.linkChanges << change;
+    }
+    std::stable_sort(scenario.transport.linkChanges.begin(), scenario.transport.linkChanges.end(),
+                     [](const TransportScript::LinkChange &a, const TransportScript::LinkChange &b)
+                     { return a.time < b.time; });
+    scenario.transport.connectTimeout = int(parseDuration(parser.value("connect-timeout")));
+    scenario.transport.errorRate = parser.value("error-rate").toDouble();
+    scenario.transport.rejectRate = parser.value("reject-rate").toDouble();
+    foreach (const QString &text, parser.values("poison"))
+    {
+        bool ok = false;
+        int hitID = text.toInt(&ok);
+        if (!ok || hitID < 0)
+        {
+            err << "Bad poisoned hit " << text << "\n";
+            return 1;
+        }
+        scenario.transport.poisoned << hitID;
+    }
+
+    if (parser.isSet("trace"))
+    {
+        if (!loadTrace(parser.value("trace"), scenario.trace))
+        {
+            err << "Cannot read trace " << parser.value("trace") << "\n";
+            return 1;
+        }
+        scenario.duration = scenario.trace.isEmpty() ? 0 : scenario.trace.last().time;
+    }
+    else
+    {
+        scenario.trace = syntheticTrace(parser.value("hits-per-hour").toDouble(), scenario.duration, scenario.seed);
+    }
+
+    foreach (const QString &outage, parser.values("outage"))
+    {
+        qint64 start = parseDuration(outage.section('+', 0, 0));
+        qint64 length = parseDuration(outage.section('+', 1));
+        if (start < 0 || length <= 0)
+        {
+            err << "Bad outage " << outage << "\n";
+            return 1;
+        }
+        scenario.transport.outages << qMakePair(start, start + length);
+    }
+    scenario.transport.outages << randomOutages(parser.value("outages-per-day").toDouble(),
+                                                parseDuration(parser.value("outage-length")),
+                                                scenario.duration, scenario.seed);
+    std::sort(scenario.transport.outages.begin(), scenario.transport.outages.end());
+
+    QStringList policyTexts = parser.values("policy");
+    if (policyTexts.isEmpty())
+    {
+        policyTexts << "interval=30s" << "interval=5m" << "interval=30s,max-age=1d";
+    }
+
+    QList<Policy> policies;
+    foreach (const QString &text, policyTexts)
+    {
+        Policy policy;
+        if (!parsePolicy(text, policy))
+        {
+            err << "Bad policy " << text << "\n";
+            return 1;
+        }
+        policies << policy;
+    }
+
+    qint64 outageTime = 0;
+    for (int i = 0; i < scenario.transport.outages.count(); ++i)
+    {
+        outageTime += scenario.transport.outages.at(i).second - scenario.transport.outages.at(i).first;
+    }
+    out << scenario.trace.count() << " hits over " << formatDuration(scenario.duration) << ", "
+        << scenario.transport.outages.count() << " outages (" << formatDuration(outageTime) << ")\n\n";
+
+    QStringList header;
+    header << "delivered" << "p50" << "p90" << "p99" << "max"
+           << "peak held" << "requests" << "hits/req" << "KB sent" << "refused" << "left" << "run time";
+    out << row("policy", header);
+
+    bool passed = true;
+    foreach (const Policy &policy, policies)
+    {
+        Result result = simulate(policy, scenario, dispatcher);
+        double ratio = result.generated ? 100.0 * result.delivered / result.generated : 100.0;
+
+        QStringList columns;
+        columns << QString("%1%").arg(ratio, 0, 'f', 2)
+                << percentile(result.latencies, 0.50)
+                << percentile(result.latencies, 0.90)
+                << percentile(result.latencies, 0.99)
+                << (result.latencies.isEmpty() ? QString("-") : formatDuration(result.latencies.last()))
+                << QString::number(result.peakHeld)
+                << QString::number(result.requests)
+                << QString::number(result.requests ? double(result.hitsSent) / result.requests : 0.0, 'f', 1)
+                << QString::number(result.bytes / 1024)
+                << QString::number(result.refused)
+                << QString::number(result.left)
+                << QString("%1ms").arg(result.runTime);
+        out << row(policy.name, columns);
+
+        foreach (const ControlSample &sample, result.control)
+        {
+            out << "    " << formatDuration(sample.time).leftJustified(10)
+                << " hits/req " << QString::number(sample.hitsPerPost).rightJustified(3)
+                << "  parallel " << QString::number(sample.concurrentPosts).rightJustified(3)
+                << "  rtt " << (sample.roundTripTime < 0 ? QString("-") : formatDuration(sample.roundTripTime)).rightJustified(8)
+                << "  hits/s " << QString::number(sample.throughput, 'f', 1).rightJustified(8) << "\n";
+        }
+
+        if (parser.isSet("check"))
+        {
+            foreach (const QString &failure, checkDelivery(scenario, result))
+            {
+                out << "    check failed: " << failure << "\n";
+                passed = false;
+            }
+        }
+        out.flush();
+    }
+
+    return passed ? 0 : 2;
+}
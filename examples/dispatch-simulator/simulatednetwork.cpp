@@ -0,0 +1,248 @@
+#include "simulatednetwork.h"
+
+#include "ganalyticscompressor.h"
+#include "ganalyticscore.h"
+
+#include <QTimer>
+#include <QUrlQuery>
+
+TransportScript::TransportScript()
+: latency(200)
+, jitter(100)
+, bandwidth(0)
+, connectTimeout(10000)
+, errorRate(0.0)
+, rejectRate(0.0)
+{
+}
+
+SimulatedNetwork::SimulatedNetwork(const TransportScript &script, const GAnalyticsClock *clock, quint32 seed, QObject *parent)
+: QNetworkAccessManager(parent)
+, script(script)
+, clock(clock)
+, origin(clock->elapsed())
+, random(seed)
+, linkBusyUntil(0)
+, requests(0)
+, bytes(0)
+, hits(0)
+{
+}
+
+const QVector<qint64> &SimulatedNetwork::deliveries() const
+{
+    return arrivals;
+}
+
+int SimulatedNetwork::requestCount() const
+{
+    return requests;
+}
+
+qint64 SimulatedNetwork::bytesSent() const
+{
+    return bytes;
+}
+
+int SimulatedNetwork::hitsSent() const
+{
+    return hits;
+}
+
+/**
+ * Record the arrival of hits at the collector.
+ * @param hitIDs
+ */
+void SimulatedNetwork::delivered(const QList<int> &hitIDs)
+{
+    foreach (int hitID, hitIDs)
+    {
+        while (hitID >= arrivals.size())
+        {
+            arrivals.append(-1);
+        }
+        if (arrivals.at(hitID) < 0)
+        {
+            arrivals[hitID] = clock->elapsed();
+        }
+    }
+}
+
+/**
+ * Decide the fate of a post and answer it later.
+ * During an outage the request times out. Otherwise the body queues
+ * for the uplink, which sends one request after the other at the
+ * scripted bandwidth, and then travels the latency. The collector
+ * fails at the scripted error rate, refuses requests which carry a
+ * refused hit or a body it cannot decompress, and accepts everything else.
+ */
+QNetworkReply *SimulatedNetwork::createRequest(Operation op, const QNetworkRequest &request, QIODevice *outgoingData)
+{
+    Q_UNUSED(op);
+
+    QByteArray body = outgoingData ? outgoingData->readAll() : QByteArray();
+    ++requests;
+    bytes += body.size();
+
+    bool corrupt = false;
+    if (request.rawHeader("Content-Encoding") == "gzip")
+    {
+        QByteArray compressed = body;
+        corrupt = !GAnalyticsCompressor::decompress(compressed, &body);
+    }
+
+    QList<int> hitIDs;
+    bool refused = false;
+    foreach (const QByteArray &line, body.split('\n'))
+    {
+        int hitID = QUrlQuery(QString::fromUtf8(line)).queryItemValue("ev").toInt();
+        refused = refused || isRefused(hitID);
+        hitIDs << hitID;
+    }
+    hits += hitIDs.count();
+
+    qint64 now = clock->elapsed() - origin;
+    if (isOutage(now))
+    {
+        return new SimulatedReply(this, request, hitIDs, 0, script.connectTimeout);
+    }
+
+    TransportScript::LinkChange current = link(now);
+    qint64 transfer = 0;
+    if (current.bandwidth > 0)
+    {
+        linkBusyUntil = qMax(linkBusyUntil, now) + body.size() * 1000 / current.bandwidth;
+        transfer = linkBusyUntil - now;
+    }
+
+    std::uniform_int_distribution<int> jitter(0, qMax(script.jitter, 0));
+    std::uniform_real_distribution<double> chance(0.0, 1.0);
+    int delay = int(transfer) + current.latency + jitter(random);
+
+    int httpStatus = 200;
+    if (chance(random) < script.errorRate)
+    {
+        httpStatus = 503;
+    }
+    else if (refused || corrupt)
+    {
+        httpStatus = 400;
+    }
+
+    return new SimulatedReply(this, request, hitIDs, httpStatus, delay);
+}
+
+bool SimulatedNetwork::isOutage(qint64 time) const
+{
+    for (int i = 0; i < script.outages.count(); ++i)
+    {
+        if (time >= script.outages.at(i).first && time < script.outages.at(i).second)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Latency and bandwidth of the link at the given time.
+ */
+TransportScript::LinkChange SimulatedNetwork::link(qint64 time) const
+{
+    TransportScript::LinkChange current;
+    current.time = 0;
+    current.latency = script.latency;
+    current.bandwidth = script.bandwidth;
+
+    foreach (const TransportScript::LinkChange &change, script.linkChanges)
+    {
+        if (change.time > time)
+        {
+            break;
+        }
+        current = change;
+    }
+
+    return current;
+}
+
+/**
+ * Whether the collector refuses a hit. The choice only depends on
+ * the id, so a refused hit is refused again when sent on its own.
+ * @param hitID
+ */
+bool SimulatedNetwork::isRefused(int hitID) const
+{
+    if (script.poisoned.contains(hitID))
+    {
+        return true;
+    }
+
+    quint32 hash = quint32(hitID) * 2654435761u;
+    return (hash % 1000000) < quint32(script.rejectRate * 1000000);
+}
+
+SimulatedReply::SimulatedReply(SimulatedNetwork *network, const QNetworkRequest &request, const QList<int> &hitIDs,
+                               int httpStatus, int delay)
+: QNetworkReply(network)
+, network(network)
+, hitIDs(hitIDs)
+, httpStatus(httpStatus)
+{
+    setRequest(request);
+    setUrl(request.url());
+    setOperation(QNetworkAccessManager::PostOperation);
+    open(QIODevice::ReadOnly);
+
+    QTimer::singleShot(delay, this, SLOT(complete()));
+}
+
+void SimulatedReply::abort()
+{
+    if (isFinished())
+    {
+        return;
+    }
+
+    setError(OperationCanceledError, "Operation canceled");
+    setFinished(true);
+    emit finished();
+}
+
+qint64 SimulatedReply::readData(char *data, qint64 maxSize)
+{
+    Q_UNUSED(data);
+    Q_UNUSED(maxSize);
+
+    return -1;
+}
+
+void SimulatedReply::complete()
+{
+    if (isFinished())
+    {
+        return;
+    }
+
+    if (httpStatus == 0)
+    {
+        setError(TimeoutError, "Connection timed out");
+    }
+    else
+    {
+        setAttribute(QNetworkRequest::HttpStatusCodeAttribute, httpStatus);
+        if (httpStatus >= 200 && httpStatus <= 299)
+        {
+            network->delivered(hitIDs);
+        }
+        else
+        {
+            setError(httpStatus >= 500 ? ServiceUnavailableError : ProtocolInvalidOperationError,
+                     QString("Simulated status %1").arg(httpStatus));
+        }
+    }
+
+    setFinished(true);
+    emit finished();
+}
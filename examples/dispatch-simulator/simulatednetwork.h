@@ -0,0 +1,106 @@
+#ifndef SIMULATEDNETWORK_H
+#define SIMULATEDNETWORK_H
+
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QPair>
+#include <QVector>
+
+#include <random>
+
+class GAnalyticsClock;
+
+/**
+ * Behaviour of the simulated collector and the network in between.
+ * Times are milliseconds relative to the start of the simulation.
+ */
+struct TransportScript
+{
+    TransportScript();
+
+    /**
+     * New link properties from the given time on.
+     */
+    struct LinkChange
+    {
+        qint64 time;
+        int latency;
+        qint64 bandwidth;
+    };
+
+    int latency;            ///< Round trip of a successful request
+    int jitter;             ///< Uniformly distributed on top of the latency
+    qint64 bandwidth;       ///< Uplink bytes per second shared by all requests, 0 for unlimited
+    QList<LinkChange> linkChanges;  ///< Ordered by time
+    int connectTimeout;     ///< Time until a request fails during an outage
+    double errorRate;       ///< Share of requests answered with 503
+    double rejectRate;      ///< Share of hits the collector refuses with 400
+    QList<int> poisoned;    ///< Hits the collector always refuses with 400
+    QList<QPair<qint64, qint64> > outages;  ///< Start and end of each outage
+};
+
+/**
+ * Network access manager which never touches the network. Every post
+ * is answered after a simulated delay on the virtual clock. Hits are
+ * identified by their event value; each hit is recorded once, the
+ * first time it arrives with a successful reply.
+ */
+class SimulatedNetwork : public QNetworkAccessManager
+{
+public:
+    SimulatedNetwork(const TransportScript &script, const GAnalyticsClock *clock, quint32 seed, QObject *parent = 0);
+
+    /// Arrival times on the virtual clock, indexed by hit id. -1 if never delivered.
+    const QVector<qint64> &deliveries() const;
+    int requestCount() const;
+    qint64 bytesSent() const;
+    int hitsSent() const;
+
+    void delivered(const QList<int> &hitIDs);
+
+protected:
+    QNetworkReply *createRequest(Operation op, const QNetworkRequest &request, QIODevice *outgoingData);
+
+private:
+    bool isOutage(qint64 time) const;
+    TransportScript::LinkChange link(qint64 time) const;
+    bool isRefused(int hitID) const;
+
+    TransportScript script;
+    const GAnalyticsClock *clock;
+    qint64 origin;
+    std::mt19937 random;
+    qint64 linkBusyUntil;       ///< Virtual time the uplink has sent everything posted so far
+    QVector<qint64> arrivals;
+    int requests;
+    qint64 bytes;
+    int hits;
+};
+
+/**
+ * Reply of the simulated network. Finishes with the scripted status
+ * once its delay has passed on the virtual clock.
+ */
+class SimulatedReply : public QNetworkReply
+{
+    Q_OBJECT
+
+public:
+    SimulatedReply(SimulatedNetwork *network, const QNetworkRequest &request, const QList<int> &hitIDs,
+                   int httpStatus, int delay);
+
+    void abort();
+
+protected:
+    qint64 readData(char *data, qint64 maxSize);
+
+private slots:
+    void complete();
+
+private:
+    SimulatedNetwork *network;
+    QList<int> hitIDs;
+    int httpStatus;
+};
+
+#endif // SIMULATEDNETWORK_H
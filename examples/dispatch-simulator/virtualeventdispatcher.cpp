@@ -0,0 +1,208 @@
+#include "virtualeventdispatcher.h"
+
+#include <QCoreApplication>
+#include <QTimerEvent>
+
+#include <limits>
+
+VirtualEventDispatcher::VirtualEventDispatcher(QObject *parent)
+: QAbstractEventDispatcher(parent)
+, currentTime(0)
+, interrupted(false)
+{
+}
+
+qint64 VirtualEventDispatcher::elapsed() const
+{
+    return currentTime;
+}
+
+/**
+ * Advance the virtual time. Timers fire in the order of their deadlines,
+ * posted events and deferred deletes are delivered in between.
+ * @param time          Virtual time in milliseconds.
+ */
+void VirtualEventDispatcher::runUntil(qint64 time)
+{
+    do
+    {
+        interrupted = false;
+        fireTimers(time);
+        QCoreApplication::sendPostedEvents(0, QEvent::DeferredDelete);
+    }
+    while (interrupted);
+
+    if (time > currentTime)
+    {
+        currentTime = time;
+    }
+}
+
+/**
+ * Called by nested event loops, like the one of GAnalytics::flush().
+ * When nothing is due, the virtual time jumps to the next deadline
+ * instead of blocking.
+ * @param flags
+ * @return processed    Whether any timer fired.
+ */
+bool VirtualEventDispatcher::processEvents(QEventLoop::ProcessEventsFlags flags)
+{
+    interrupted = false;
+    emit awake();
+    QCoreApplication::sendPostedEvents();
+
+    bool processed = fireTimers(currentTime);
+    if (!processed && !interrupted && (flags & QEventLoop::WaitForMoreEvents))
+    {
+        int timerId = nextTimer(std::numeric_limits<qint64>::max());
+        if (timerId >= 0)
+        {
+            processed = fireTimers(timers.value(timerId).due);
+        }
+    }
+
+    return processed;
+}
+
+#if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
+bool VirtualEventDispatcher::hasPendingEvents()
+{
+    return false;
+}
+
+void VirtualEventDispatcher::flush()
+{
+}
+#endif
+
+void VirtualEventDispatcher::registerSocketNotifier(QSocketNotifier *notifier)
+{
+    // The simulated transport does not use sockets.
+    Q_UNUSED(notifier);
+}
+
+void VirtualEventDispatcher::unregisterSocketNotifier(QSocketNotifier *notifier)
+{
+    Q_UNUSED(notifier);
+}
+
+void VirtualEventDispatcher::registerTimer(int timerId, Interval interval, Qt::TimerType timerType, QObject *object)
+{
+    Timer timer;
+    timer.interval = interval;
+    timer.type = timerType;
+    timer.object = object;
+    timer.due = currentTime + interval;
+    timers.insert(timerId, timer);
+}
+
+bool VirtualEventDispatcher::unregisterTimer(int timerId)
+{
+    return timers.remove(timerId) > 0;
+}
+
+bool VirtualEventDispatcher::unregisterTimers(QObject *object)
+{
+    bool removed = false;
+    QMutableHashIterator<int, Timer> iter(timers);
+    while (iter.hasNext())
+    {
+        if (iter.next().value().object == object)
+        {
+            iter.remove();
+            removed = true;
+        }
+    }
+
+    return removed;
+}
+
+QList<QAbstractEventDispatcher::TimerInfo> VirtualEventDispatcher::registeredTimers(QObject *object) const
+{
+    QList<TimerInfo> list;
+    for (QHash<int, Timer>::const_iterator iter = timers.begin(); iter != timers.end(); ++iter)
+    {
+        if (iter.value().object == object)
+        {
+            list << TimerInfo(iter.key(), int(iter.value().interval), iter.value().type);
+        }
+    }
+
+    return list;
+}
+
+int VirtualEventDispatcher::remainingTime(int timerId)
+{
+    if (!timers.contains(timerId))
+    {
+        return -1;
+    }
+
+    return int(qMax<qint64>(0, timers.value(timerId).due - currentTime));
+}
+
+void VirtualEventDispatcher::wakeUp()
+{
+}
+
+void VirtualEventDispatcher::interrupt()
+{
+    interrupted = true;
+}
+
+/**
+ * Find the timer with the earliest deadline. Timers with the same
+ * deadline fire in the order of their ids, which keeps runs repeatable.
+ * @param until         Ignore timers due later than this.
+ * @return timerId      Or -1 if no timer is due.
+ */
+int VirtualEventDispatcher::nextTimer(qint64 until) const
+{
+    int timerId = -1;
+    qint64 due = until;
+    for (QHash<int, Timer>::const_iterator iter = timers.begin(); iter != timers.end(); ++iter)
+    {
+        if (iter.value().due < due || (iter.value().due == due && (timerId < 0 || iter.key() < timerId)))
+        {
+            timerId = iter.key();
+            due = iter.value().due;
+        }
+    }
+
+    return timerId;
+}
+
+/**
+ * Fire all timers due until the given time. A repeating timer is
+ * rescheduled before its event is delivered, so the receiver may
+ * stop or restart it.
+ * @param until
+ * @return fired        Whether any timer fired.
+ */
+bool VirtualEventDispatcher::fireTimers(qint64 until)
+{
+    bool fired = false;
+    for (;;)
+    {
+        QCoreApplication::sendPostedEvents();
+
+        int timerId = nextTimer(until);
+        if (timerId < 0 || interrupted)
+        {
+            break;
+        }
+
+        Timer &timer = timers[timerId];
+        if (timer.due > currentTime)
+        {
+            currentTime = timer.due;
+        }
+        timer.due = currentTime + qMax<qint64>(timer.interval, 1);
+
+        QTimerEvent event(timerId);
+        QCoreApplication::sendEvent(timer.object, &event);
+        fired = true;
+    }
+
+    return fired;
+}
@@ -0,0 +1,68 @@
+#ifndef VIRTUALEVENTDISPATCHER_H
+#define VIRTUALEVENTDISPATCHER_H
+
+#include <QAbstractEventDispatcher>
+#include <QHash>
+
+#include "ganalyticscore.h"
+
+/**
+ * Event dispatcher for the main thread which runs on virtual time.
+ * All QTimers of the tracker (send interval, throttle, settings writes)
+ * and of the simulated transport fire in the order of their virtual
+ * deadlines, without waiting. The dispatcher is also the clock the
+ * tracker stamps its messages with.
+ * Must be installed before the QCoreApplication is created.
+ */
+class VirtualEventDispatcher : public QAbstractEventDispatcher, public GAnalyticsClock
+{
+public:
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+    typedef qint64 Interval;
+#else
+    typedef int Interval;
+#endif
+
+    explicit VirtualEventDispatcher(QObject *parent = 0);
+
+    qint64 elapsed() const;
+
+    /// Fire everything which is due until the given virtual time and stop there.
+    void runUntil(qint64 time);
+
+    bool processEvents(QEventLoop::ProcessEventsFlags flags);
+#if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
+    bool hasPendingEvents();
+    void flush();
+#endif
+
+    void registerSocketNotifier(QSocketNotifier *notifier);
+    void unregisterSocketNotifier(QSocketNotifier *notifier);
+
+    void registerTimer(int timerId, Interval interval, Qt::TimerType timerType, QObject *object);
+    bool unregisterTimer(int timerId);
+    bool unregisterTimers(QObject *object);
+    QList<TimerInfo> registeredTimers(QObject *object) const;
+    int remainingTime(int timerId);
+
+    void wakeUp();
+    void interrupt();
+
+private:
+    struct Timer
+    {
+        qint64 interval;
+        Qt::TimerType type;
+        QObject *object;
+        qint64 due;
+    };
+
+    int nextTimer(qint64 until) const;
+    bool fireTimers(qint64 until);
+
+    QHash<int, Timer> timers;
+    qint64 currentTime;
+    bool interrupted;
+};
+
+#endif // VIRTUALEVENTDISPATCHER_H
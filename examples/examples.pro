@@ -2,4 +2,7 @@ TEMPLATE = subdirs
 
 SUBDIRS += \
     console-app \
+    dispatch-simulator \
+    headless-service \
+    qml-benchmark \
     qtquick-app
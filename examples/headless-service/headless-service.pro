@@ -0,0 +1,9 @@
+TEMPLATE = app
+QT = core network
+
+CONFIG += console
+CONFIG -= app_bundle
+
+SOURCES += main.cpp
+
+include(../../qt-google-analytics-core.pri)
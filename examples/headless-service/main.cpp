@@ -0,0 +1,100 @@
+#include <QCoreApplication>
+#include <QDebug>
+#include <QTcpSocket>
+#include <QUuid>
+
+#include "ganalyticscore.h"
+
+/**
+ * Posts with the blocking API of QTcpSocket, which works
+ * without a running event loop.
+ */
+class SocketTransport : public GAnalyticsTransport
+{
+public:
+    explicit SocketTransport(int timeout)
+    : timeout(timeout)
+    {
+    }
+
+    int post(const QUrl &url, QIODevice *body, const QByteArray &contentEncoding,
+             const QString &userAgent, QString *errorString)
+    {
+        QTcpSocket socket;
+        socket.connectToHost(url.host(), quint16(url.port(80)));
+        if (!socket.waitForConnected(timeout))
+        {
+            *errorString = socket.errorString();
+            return 0;
+        }
+
+        QByteArray encodingHeader;
+        if (!contentEncoding.isEmpty())
+        {
+            encodingHeader = "Content-Encoding: " + contentEncoding + "\r\n";
+        }
+
+        socket.write("POST " + url.path(QUrl::FullyEncoded).toUtf8() + " HTTP/1.1\r\n"
+                     "Host: " + url.host().toUtf8() + "\r\n"
+                     "User-Agent: " + userAgent.toUtf8() + "\r\n"
+                     "Content-Type: application/x-www-form-urlencoded\r\n"
+                     + encodingHeader +
+                     "Content-Length: " + QByteArray::number(body->size()) + "\r\n"
+                     "Connection: close\r\n"
+                     "\r\n");
+
+        // Copy the body in small chunks, it is never held in one piece.
+        char chunk[4096];
+        qint64 length;
+        while ((length = body->read(chunk, sizeof(chunk))) > 0)
+        {
+            socket.write(chunk, length);
+            if (socket.bytesToWrite() > qint64(sizeof(chunk)) && !socket.waitForBytesWritten(timeout))
+            {
+                *errorString = socket.errorString();
+                return 0;
+            }
+        }
+
+        while (!socket.canReadLine())
+        {
+            if (!socket.waitForReadyRead(timeout))
+            {
+                *errorString = socket.errorString();
+                return 0;
+            }
+        }
+
+        // "HTTP/1.1 200 OK"
+        QList<QByteArray> statusLine = socket.readLine().split(' ');
+        return statusLine.count() > 1 ? statusLine.at(1).toInt() : 0;
+    }
+
+private:
+    int timeout;
+};
+
+int main(int argc, char* argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    // No event loop is started. Everything below runs synchronously.
+    GAnalyticsCore core;
+    core.setTrackingID("UA-53395376-1");
+    core.setClientID(QUuid::createUuid().toString());
+    core.setAppName("Headless-Service");
+    core.setAppVersion("0.1");
+    core.setUserAgent("Headless-Service/0.1 GAnalytics/1.0");
+
+    for (int job = 1; job <= 3; ++job)
+    {
+        core.enqueue(core.buildEventQuery("jobs", "finished", QString(), job));
+    }
+
+    SocketTransport transport(2000);
+    int sent = core.send(&transport, 5 * 1000);
+
+    qDebug() << "Done." << sent << "sent," << core.count() << "left in the queue.";
+
+    return 0;
+}
@@ -0,0 +1,36 @@
+import QtQuick 2.0
+import analytics 0.1
+
+// Pages 1 and 2 report themselves through the attached property,
+// pages 3 and 4 call sendScreenView() from JavaScript.
+Item {
+    id: root
+
+    property int page: 0
+    property alias tracker: tracker
+
+    Tracker {
+        id: tracker
+        trackingID: "UA-00000000-1"
+    }
+
+    Item {
+        visible: root.page == 1
+        Tracker.screenName: "Overview"
+    }
+
+    Item {
+        visible: root.page == 2
+        Tracker.screenName: "Details"
+    }
+
+    Item {
+        visible: root.page == 3
+        onVisibleChanged: if (visible) tracker.sendScreenView("Overview")
+    }
+
+    Item {
+        visible: root.page == 4
+        onVisibleChanged: if (visible) tracker.sendScreenView("Details")
+    }
+}
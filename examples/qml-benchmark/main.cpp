@@ -0,0 +1,91 @@
+#include <QElapsedTimer>
+#include <QGuiApplication>
+#include <QQmlComponent>
+#include <QQmlEngine>
+#include <QTextStream>
+#include <QtQml>
+
+#include "ganalytics.h"
+#include "ganalyticsreachability.h"
+
+/**
+ * QML benchmark
+ * Switches between two pages many times, once with pages reporting
+ * themselves through Tracker.screenName and once with pages calling
+ * sendScreenView() from JavaScript, and reports the time per switch.
+ * The tracker stays offline, so nothing is sent.
+ */
+
+/**
+ * Show the pages first and first + 1 in turns.
+ * @return nanoseconds  Time per switch, including the queued screen view.
+ */
+static qint64 navigate(QObject *root, int first, int navigations)
+{
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < navigations; ++i)
+    {
+        root->setProperty("page", first + i % 2);
+        QCoreApplication::processEvents();
+    }
+    qint64 elapsed = timer.nsecsElapsed();
+    root->setProperty("page", 0);
+
+    return elapsed / navigations;
+}
+
+static int queued(GAnalytics *tracker)
+{
+    return tracker->stats().value("queuedNormal").toInt();
+}
+
+int main(int argc, char* argv[])
+{
+    QGuiApplication::setOrganizationName("HSAnet");
+    QGuiApplication::setApplicationName("QML-Benchmark");
+    QGuiApplication::setApplicationVersion("0.1");
+
+    QGuiApplication app(argc, argv);
+
+    qmlRegisterType<GAnalytics>("analytics", 0, 1, "Tracker");
+
+    QQmlEngine engine;
+    QQmlComponent component(&engine, QUrl("qrc:/qml/Benchmark.qml"));
+    QObject *root = component.create();
+    QTextStream out(stdout);
+    if (!root)
+    {
+        out << component.errorString();
+        return 1;
+    }
+
+    GAnalytics *tracker = qobject_cast<GAnalytics*>(root->property("tracker").value<QObject*>());
+    GAnalyticsManualReachability *reachability = new GAnalyticsManualReachability;
+    tracker->setReachability(reachability);
+    reachability->setOnline(false);
+
+    const int navigations = argc > 1 ? QString(argv[1]).toInt() : 10000;
+    const int warmUp = 100;
+
+    out << "nanoseconds per screen change, " << navigations << " changes\n";
+
+    navigate(root, 1, warmUp);
+    int before = queued(tracker);
+    qint64 attached = navigate(root, 1, navigations);
+    int attachedViews = queued(tracker) - before;
+
+    navigate(root, 3, warmUp);
+    before = queued(tracker);
+    qint64 javaScript = navigate(root, 3, navigations);
+    int javaScriptViews = queued(tracker) - before;
+
+    out << "    " << QString("attached").leftJustified(12) << QString::number(attached).rightJustified(10)
+        << "   " << attachedViews << " screen views\n"
+        << "    " << QString("javascript").leftJustified(12) << QString::number(javaScript).rightJustified(10)
+        << "   " << javaScriptViews << " screen views\n";
+
+    delete root;
+
+    return 0;
+}
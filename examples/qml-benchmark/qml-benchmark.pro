@@ -0,0 +1,15 @@
+TEMPLATE = app
+QT += quick qml network
+
+CONFIG += console
+CONFIG -= app_bundle
+
+SOURCES += main.cpp
+
+include(../../qt-google-analytics.pri)
+
+OTHER_FILES += \
+    Benchmark.qml
+
+RESOURCES += \
+    resource.qrc
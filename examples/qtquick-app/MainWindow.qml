@@ -134,5 +134,52 @@ ApplicationWindow {
                 }
             }
         }
+
+        GroupBox {
+            Layout.fillWidth: true
+            title: "Screens"
+
+            // Each page reports itself when it becomes visible, no call needed.
+            ColumnLayout {
+                anchors.fill: parent
+
+                StackView {
+                    id: stack
+                    Layout.fillWidth: true
+                    Layout.preferredHeight: 40
+                    initialItem: overviewPage
+                }
+
+                RowLayout {
+                    Button {
+                        text: "Show details"
+                        enabled: stack.depth == 1
+                        onClicked: stack.push(detailsPage)
+                    }
+
+                    Button {
+                        text: "Back"
+                        enabled: stack.depth > 1
+                        onClicked: stack.pop()
+                    }
+                }
+            }
+
+            Component {
+                id: overviewPage
+                Label {
+                    Tracker.screenName: "Overview"
+                    text: "Overview"
+                }
+            }
+
+            Component {
+                id: detailsPage
+                Label {
+                    Tracker.screenName: "Details"
+                    text: "Details"
+                }
+            }
+        }
     }
 }
@@ -1,15 +1,26 @@
-#include "ganalytics.h"
+#include "ganalytics_p.h"
+#include "ganalyticsbatchbody.h"
+#include "ganalyticsreachability.h"
+#include "ganalyticsspool.h"
+#include "ganalyticstrace.h"
 
 #include <QCoreApplication>
 #include <QDataStream>
 #include <QDateTime>
 #include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
 #include <QLocale>
 #include <QNetworkAccessManager>
 #include <QNetworkReply>
 #include <QNetworkRequest>
-#include <QQueue>
-#include <QSettings>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QStringList>
 #include <QTimer>
 #include <QUrlQuery>
 #include <QUuid>
@@ -20,77 +31,19 @@
 #endif // QT_GUI_LIB
 
 #ifdef QT_QML_LIB
+#include "ganalyticsattached.h"
+
 #include <QQmlEngine>
 #include <QQmlContext>
 #endif // QT_QML_LIB
 
-struct QueryBuffer
-{
-    QUrlQuery postQuery;
-    QDateTime time;
-};
-
-/**
- * Class Private
- * Private members and functions.
- */
-class GAnalytics::Private : public QObject
-{
-    Q_OBJECT
-
-public:
-    explicit Private(GAnalytics *parent = 0);
-    ~Private();
-
-    GAnalytics *q;
+const QString GAnalytics::Private::queueKey = "GAnalytics-queue";
 
-    QNetworkAccessManager *networkManager;
-
-    QQueue<QueryBuffer> messageQueue;
-    QTimer timer;
-    QNetworkRequest request;
-    GAnalytics::LogLevel logLevel;
-
-    QString trackingID;
-    QString clientID;
-    QString userID;
-    QString appName;
-    QString appVersion;
-    QString language;
-    QString screenResolution;
-    QString viewportSize;
-
-    bool isSending;
-
-    const static int fourHours = 4 * 60 * 60 * 1000;
-    const static QString dateTimeFormat;
-
-public:
-    void logMessage(GAnalytics::LogLevel level, const QString &message);
-
-    QUrlQuery buildStandardPostQuery(const QString &type);
-#ifdef QT_GUI_LIB
-    QString getScreenResolution();
-#endif // QT_GUI_LIB
-    QString getUserAgent();
-    QString getSystemInfo();
-    QList<QString> persistMessageQueue();
-    void readMessagesFromFile(const QList<QString> &dataList);
-    QString getClientID();
-    QString getUserID();
-    void setUserID(const QString &userID);
-    void enqueQueryWithCurrentTime(const QUrlQuery &query);
-    void setIsSending(bool doSend);
-
-signals:
-    void postNextMessage();
-
-public slots:
-    void postMessage();
-    void postMessageFinished();
-};
-
-const QString GAnalytics::Private::dateTimeFormat  = "yyyy,MM,dd-hh:mm::ss:zzz";
+// The public enums are converted to the core's by value
+Q_STATIC_ASSERT(int(GAnalytics::Debug) == int(GAnalyticsCore::Debug) && int(GAnalytics::Info) == int(GAnalyticsCore::Info)
+                && int(GAnalytics::Error) == int(GAnalyticsCore::Error) && int(GAnalytics::None) == int(GAnalyticsCore::None));
+Q_STATIC_ASSERT(int(GAnalytics::Urgent) == int(GAnalyticsCore::Urgent) && int(GAnalytics::Normal) == int(GAnalyticsCore::Normal)
+                && int(GAnalytics::Bulk) == int(GAnalyticsCore::Bulk));
 
 /**
  * Constructor
@@ -101,23 +54,37 @@ GAnalytics::Private::Private(GAnalytics *parent)
 : QObject(parent)
 , q(parent)
 , networkManager(NULL)
+, currentReply(NULL)
+, reachability(NULL)
+, spool(NULL)
 , request(QUrl("http://www.google-analytics.com/collect"))
-, logLevel(GAnalytics::Error)
 , isSending(false)
+, isFlushing(false)
+, batchFailed(false)
+, batchPosts(0)
+, flushLoop(NULL)
 {
-    clientID = getClientID();
-    userID = getUserID();
-    language = QLocale::system().name().toLower().replace("_", "-");
+    core.setClientID(getClientID());
+    core.setUserID(getUserID());
+    restorePersistedQueue();
+    core.setLanguage(QLocale::system().name().toLower().replace("_", "-"));
 #ifdef QT_GUI_LIB
-    screenResolution = getScreenResolution();
+    core.setScreenResolution(getScreenResolution());
 #endif // QT_GUI_LIB
     request.setHeader(QNetworkRequest::ContentTypeHeader, "application/x-www-form-urlencoded");
-    appName = QCoreApplication::instance()->applicationName();
-    appVersion = QCoreApplication::instance()->applicationVersion();
-    request.setHeader(QNetworkRequest::UserAgentHeader, getUserAgent());
+    core.setAppName(QCoreApplication::instance()->applicationName());
+    core.setAppVersion(QCoreApplication::instance()->applicationVersion());
+    core.setUserAgent(getUserAgent());
+    request.setHeader(QNetworkRequest::UserAgentHeader, core.userAgent());
     connect(this, SIGNAL(postNextMessage()), this, SLOT(postMessage()));
-    timer.start(30000);
-    connect(&timer, SIGNAL(timeout()), this, SLOT(postMessage()));
+    timer.setInterval(30000);
+    connect(&timer, SIGNAL(timeout()), this, SLOT(timerTick()));
+    connect(&summaryTimer, SIGNAL(timeout()), this, SLOT(publishTimingSummaries()));
+    throttleTimer.setSingleShot(true);
+    connect(&throttleTimer, SIGNAL(timeout()), this, SLOT(throttleExpired()));
+    reachability = new GAnalyticsSystemReachability(this);
+    connect(reachability, SIGNAL(onlineChanged(bool)), this, SLOT(onlineChanged(bool)));
+    setIsSending(false);
 }
 
 /**
@@ -126,43 +93,37 @@ GAnalytics::Private::Private(GAnalytics *parent)
  */
 GAnalytics::Private::~Private()
 {
+    delete spool;
 }
 
 void GAnalytics::Private::logMessage(LogLevel level, const QString &message)
 {
-    if (logLevel > level)
-    {
-        return;
-    }
-
-    qDebug() << "[Analytics]" << message;
+    core.logMessage(GAnalyticsCore::LogLevel(level), message);
 }
 
 /**
- * Build the POST query. Adds all parameter to the query
- * which are used in every POST.
- * @param type      Type of POST message. The event which is to post.
- * @return query    Most used parameter in a query for a POST.
+ * Turn the aggregated timings into messages. Per category and
+ * variable, the p50, p90, p99 and max durations are sent as
+ * timings labelled accordingly and the number of timings as
+ * an event. They go into the bulk lane.
  */
-QUrlQuery GAnalytics::Private::buildStandardPostQuery(const QString &type)
+void GAnalytics::Private::publishTimingSummaries()
 {
-    QUrlQuery query;
-    query.addQueryItem("v", "1");
-    query.addQueryItem("tid", trackingID);
-    query.addQueryItem("cid", clientID);
-    if(!userID.isEmpty())
+    foreach (const GAnalyticsHistogram::Summary &summary, histograms.takeSummaries())
     {
-        query.addQueryItem("uid", userID);
+        enqueQueryWithCurrentTime(core.buildTimingQuery(summary.category, summary.variable, summary.p50, "p50"), GAnalytics::Bulk);
+        enqueQueryWithCurrentTime(core.buildTimingQuery(summary.category, summary.variable, summary.p90, "p90"), GAnalytics::Bulk);
+        enqueQueryWithCurrentTime(core.buildTimingQuery(summary.category, summary.variable, summary.p99, "p99"), GAnalytics::Bulk);
+        enqueQueryWithCurrentTime(core.buildTimingQuery(summary.category, summary.variable, summary.max, "max"), GAnalytics::Bulk);
+        enqueQueryWithCurrentTime(core.buildEventQuery("Timing", summary.category + "/" + summary.variable,
+                                                       "count", summary.count), GAnalytics::Bulk);
     }
-    query.addQueryItem("t", type);
-    query.addQueryItem("ul", language);
 
-#ifdef QT_GUI_LIB
-    query.addQueryItem("vp", viewportSize);
-    query.addQueryItem("sr", screenResolution);
-#endif // QT_GUI_LIB
-
-    return query;
+    int dropped = droppedTimings.fetchAndStoreRelaxed(0);
+    if (dropped > 0)
+    {
+        logMessage(GAnalytics::Error, QString("%1 timings dropped, too many timing variables").arg(dropped));
+    }
 }
 
 #ifdef QT_GUI_LIB
@@ -192,7 +153,7 @@ QString GAnalytics::Private::getUserAgent()
     QString locale = QLocale::system().name();
     QString system = getSystemInfo();
 
-    return QString("%1/%2 (%3; %4) GAnalytics/1.0 (Qt/%5)").arg(appName).arg(appVersion).arg(system).arg(locale).arg(QT_VERSION_STR);
+    return QString("%1/%2 (%3; %4) GAnalytics/1.0 (Qt/%5)").arg(core.appName()).arg(core.appVersion()).arg(system).arg(locale).arg(QT_VERSION_STR);
 }
 
 
@@ -401,59 +362,13 @@ QString GAnalytics::Private::getSystemInfo()
 #endif
 
 
-/**
- * The message queue contains a list of QueryBuffer object.
- * QueryBuffer holds a QUrlQuery object and a QDateTime object.
- * These both object are freed from the buffer object and
- * inserted as QString objects in a QList.
- * @return dataList     The list with concartinated queue data.
- */
-QList<QString> GAnalytics::Private::persistMessageQueue()
-{
-    QList<QString> dataList;
-    foreach (QueryBuffer buffer, messageQueue)
-    {
-        dataList << buffer.postQuery.toString();
-        dataList << buffer.time.toString(dateTimeFormat);
-    }
-
-    return dataList;
-}
-
-/**
- * Reads persistent messages from a file.
- * Gets all message data as a QList<QString>.
- * Two lines in the list build a QueryBuffer object.
- */
-void GAnalytics::Private::readMessagesFromFile(const QList<QString> &dataList)
-{
-    QListIterator<QString> iter(dataList);
-    while (iter.hasNext())
-    {
-        QString queryString = iter.next();
-        if(!iter.hasNext())
-            break;
-        QString dateString = iter.next();
-        if(queryString.isEmpty() || dateString.isEmpty())
-            break;
-        QUrlQuery query;
-        query.setQuery(queryString);
-        QDateTime dateTime = QDateTime::fromString(dateString, dateTimeFormat);
-        QueryBuffer buffer;
-        buffer.postQuery = query;
-        buffer.time = dateTime;
-        messageQueue.enqueue(buffer);
-    }
-}
-
 /**
  * Change the user id.
  * @param userID         A string with the user id.
  */
 void GAnalytics::Private::setUserID(const QString &userID)
 {
-    this->userID = userID;
-    QSettings settings;
+    core.setUserID(userID);
     settings.setValue("GAnalytics-uid", userID);
 }
 
@@ -463,8 +378,7 @@ void GAnalytics::Private::setUserID(const QString &userID)
  * @return userID         A string with the user id.
  */
 QString GAnalytics::Private::getUserID()
-{    
-    QSettings settings;
+{
     QString userID = settings.value("GAnalytics-uid", QString("")).toString();
 
     return userID;
@@ -477,7 +391,6 @@ QString GAnalytics::Private::getUserID()
  */
 QString GAnalytics::Private::getClientID()
 {
-    QSettings settings;
     QString clientID;
     if (!settings.contains("GAnalytics-cid"))
     {
@@ -493,18 +406,84 @@ QString GAnalytics::Private::getClientID()
 }
 
 /**
- * Takes a QUrlQuery object and wrapp it together with
- * a QTime object into a QueryBuffer struct. These struct
- * will be stored in the message queue.
+ * Switch to another settings store and pick up the
+ * client and user id persisted there.
+ * @param store         The new store. Ownership is taken.
+ */
+void GAnalytics::Private::setSettingsStore(GAnalyticsSettingsStore *store)
+{
+    settings.setStore(store);
+    core.setClientID(getClientID());
+    core.setUserID(getUserID());
+    restorePersistedQueue();
+}
+
+/**
+ * Enqueue the messages a previous flush() could not send
+ * and remove them from the store. The pages go into the
+ * backlog, so only a bounded part is held in memory.
+ */
+void GAnalytics::Private::restorePersistedQueue()
+{
+    GANALYTICS_TRACE_SPAN("restorePersistedQueue");
+
+    if (settings.contains(queueKey))
+    {
+        // Written by versions that kept the queue in the settings.
+        core.readMessages(settings.value(queueKey).toStringList());
+        settings.remove(queueKey);
+    }
+
+    QFile file(queueFileName());
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        return;
+    }
+
+    QDataStream inStream(&file);
+    inStream.setVersion(QDataStream::Qt_5_0);
+    core.readMessages(inStream);
+    file.close();
+    file.remove();
+}
+
+/**
+ * File the messages left by flush() are written to.
+ */
+QString GAnalytics::Private::queueFileName() const
+{
+    return QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) + "/ganalytics-queue";
+}
+
+/**
+ * Queue a message with the current time.
+ * Urgent messages are posted right away.
  * @param query
+ * @param priority
  */
-void GAnalytics::Private::enqueQueryWithCurrentTime(const QUrlQuery &query)
+void GAnalytics::Private::enqueQueryWithCurrentTime(const QUrlQuery &query, GAnalytics::Priority priority)
 {
-    QueryBuffer buffer;
-    buffer.postQuery = query;
-    buffer.time = QDateTime::currentDateTime();
+    enqueQueryWithCurrentTime(query.query(QUrl::FullyEncoded).toUtf8(), priority);
+}
 
-    messageQueue.enqueue(buffer);
+/**
+ * Queue an encoded message with the current time.
+ * @param encodedQuery
+ * @param priority
+ */
+void GAnalytics::Private::enqueQueryWithCurrentTime(const QByteArray &encodedQuery, GAnalytics::Priority priority)
+{
+    if (encodedQuery.isEmpty())
+    {
+        return;
+    }
+
+    core.enqueue(encodedQuery, GAnalyticsCore::Priority(priority));
+
+    if (priority == GAnalytics::Urgent)
+    {
+        postUrgentMessages();
+    }
 }
 
 /**
@@ -513,7 +492,9 @@ void GAnalytics::Private::enqueQueryWithCurrentTime(const QUrlQuery &query)
  */
 void GAnalytics::Private::setIsSending(bool doSend)
 {
-    if (doSend)
+    // While offline there is nothing to wake up for,
+    // unless messages are exchanged through the shared spool.
+    if (doSend || (!reachability->isOnline() && !spool))
     {
         timer.stop();
     }
@@ -565,59 +546,59 @@ GAnalytics::~GAnalytics()
 
 void GAnalytics::setLogLevel(GAnalytics::LogLevel logLevel)
 {
-    if (d->logLevel != logLevel)
+    if (d->core.logLevel() != GAnalyticsCore::LogLevel(logLevel))
     {
-        d->logLevel = logLevel;
+        d->core.setLogLevel(GAnalyticsCore::LogLevel(logLevel));
         emit logLevelChanged();
     }
 }
 
 GAnalytics::LogLevel GAnalytics::logLevel() const
 {
-    return d->logLevel;
+    return LogLevel(d->core.logLevel());
 }
 
 // SETTER and GETTER
 void GAnalytics::setViewportSize(const QString &viewportSize)
 {
-    if (d->viewportSize != viewportSize)
+    if (d->core.viewportSize() != viewportSize)
     {
-        d->viewportSize = viewportSize;
+        d->core.setViewportSize(viewportSize);
         emit viewportSizeChanged();
     }
 }
 
 QString GAnalytics::viewportSize() const
 {
-    return d->viewportSize;
+    return d->core.viewportSize();
 }
 
 void GAnalytics::setLanguage(const QString &language)
 {
-    if (d->language != language)
+    if (d->core.language() != language)
     {
-        d->language = language;
+        d->core.setLanguage(language);
         emit languageChanged();
     }
 }
 
 QString GAnalytics::language() const
 {
-    return d->language;
+    return d->core.language();
 }
 
 void GAnalytics::setTrackingID(const QString &trackingID)
 {
-    if (d->trackingID != trackingID)
+    if (d->core.trackingID() != trackingID)
     {
-        d->trackingID = trackingID;
+        d->core.setTrackingID(trackingID);
         emit trackingIDChanged();
     }
 }
 
 QString GAnalytics::trackingID() const
 {
-    return d->trackingID;
+    return d->core.trackingID();
 }
 
 void GAnalytics::setSendInterval(int milliseconds)
@@ -631,7 +612,7 @@ void GAnalytics::setSendInterval(int milliseconds)
 
 void GAnalytics::setUserID(const QString &userID)
 {
-    if(d->userID != userID)
+    if(d->core.userID() != userID)
     {
         d->setUserID(userID);
         emit userIDChanged();
@@ -640,7 +621,7 @@ void GAnalytics::setUserID(const QString &userID)
 
 QString GAnalytics::userID() const
 {
-    return d->getUserID();
+    return d->core.userID();
 }
 
 int GAnalytics::sendInterval() const
@@ -648,6 +629,38 @@ int GAnalytics::sendInterval() const
     return (d->timer.interval());
 }
 
+/**
+ * Switch timing aggregation on or off. Switching it off publishes the
+ * histograms right away. Must not be called while other threads record
+ * timings: a timing recorded during the switch may be left in the
+ * histograms until aggregation is switched on again.
+ * @param milliseconds  Publishing interval, 0 sends every timing.
+ */
+void GAnalytics::setTimingAggregationInterval(int milliseconds)
+{
+    if (milliseconds > 0)
+    {
+        d->summaryTimer.start(milliseconds);
+        d->aggregateTimings.storeRelease(1);
+    }
+    else if (d->summaryTimer.isActive())
+    {
+        d->aggregateTimings.storeRelease(0);
+        d->summaryTimer.stop();
+        d->publishTimingSummaries();
+    }
+}
+
+int GAnalytics::timingAggregationInterval() const
+{
+    return d->summaryTimer.isActive() ? d->summaryTimer.interval() : 0;
+}
+
+GAnalytics::FlushResult GAnalytics::flush(int deadline)
+{
+    return d->flush(deadline);
+}
+
 void GAnalytics::startSending()
 {
     if (!isSending())
@@ -678,12 +691,161 @@ QNetworkAccessManager *GAnalytics::networkAccessManager() const
     return d->networkManager;
 }
 
-static void appendCustomValues(QUrlQuery &query, const QVariantMap &customValues) {
-  for(QVariantMap::const_iterator iter = customValues.begin(); iter != customValues.end(); ++iter) {
-    query.addQueryItem(iter.key(), iter.value().toString());
-  }
+void GAnalytics::setSettingsStore(GAnalyticsSettingsStore *store)
+{
+    QString oldUserID = d->core.userID();
+    d->setSettingsStore(store);
+    if (d->core.userID() != oldUserID)
+    {
+        emit userIDChanged();
+    }
+}
+
+GAnalyticsSettingsStore *GAnalytics::settingsStore() const
+{
+    return d->settings.store();
+}
+
+QVariantMap GAnalytics::stats() const
+{
+    int inFlight = 0;
+    foreach (const GAnalyticsCore::Batch &batch, d->inFlight)
+    {
+        inFlight += batch.messages.count();
+    }
+
+    QVariantMap stats;
+    stats.insert("queuedUrgent", d->core.count(GAnalyticsCore::Urgent));
+    stats.insert("queuedNormal", d->core.count(GAnalyticsCore::Normal));
+    stats.insert("queuedBulk", d->core.count(GAnalyticsCore::Bulk));
+    stats.insert("backlog", d->core.backlogCount());
+    stats.insert("inFlight", inFlight);
+    stats.insert("sent", d->core.sentCount());
+    stats.insert("rejected", d->core.rejectedCount());
+    stats.insert("deadLetters", d->core.deadLetters().count());
+    stats.insert("online", d->reachability->isOnline());
+    stats.insert("spoolSender", d->spool ? d->spool->isSender() : true);
+    stats.insert("persistedBytes", d->core.persistedBytes());
+    // Bytes written per 10000 persisted messages, for comparing the page encodings
+    qint64 persistedMessages = d->core.persistedMessageCount();
+    stats.insert("persistedBytesPer10k", persistedMessages > 0 ? d->core.persistedBytes() * 10000 / persistedMessages : 0);
+    if (d->core.adaptiveDispatch())
+    {
+        const GAnalyticsCongestionControl &control = d->core.congestionControl();
+        stats.insert("hitsPerPost", control.hitsPerPost());
+        stats.insert("concurrentPosts", control.concurrentPosts());
+        stats.insert("roundTripTime", control.roundTripTime());
+        stats.insert("throughput", control.throughput());
+    }
+    // Wire size of compressed bodies relative to their original size, 1 if nothing was compressed
+    qint64 compressedBodyBytes = d->core.compressedBodyBytes();
+    stats.insert("compressedBytes", compressedBodyBytes);
+    stats.insert("compressionRatio", compressedBodyBytes > 0
+                 ? double(d->core.compressedWireBytes()) / compressedBodyBytes : 1.0);
+
+    return stats;
+}
+
+void GAnalytics::setReachability(GAnalyticsReachability *reachability)
+{
+    d->setReachability(reachability);
+}
+
+GAnalyticsReachability *GAnalytics::reachability() const
+{
+    return d->reachability;
 }
 
+void GAnalytics::setSharedSpoolDirectory(const QString &directory)
+{
+    d->setSharedSpoolDirectory(directory);
+}
+
+void GAnalytics::setRateLimit(int burst, double messagesPerSecond)
+{
+    d->core.setRateLimit(burst, messagesPerSecond);
+}
+
+int GAnalytics::rateLimitBurst() const
+{
+    return d->core.rateLimitBurst();
+}
+
+double GAnalytics::rateLimitPerSecond() const
+{
+    return d->core.rateLimitPerSecond();
+}
+
+void GAnalytics::setEndpoint(const QUrl &endpoint)
+{
+    d->core.setEndpoint(endpoint);
+}
+
+QUrl GAnalytics::endpoint() const
+{
+    return d->core.endpoint();
+}
+
+void GAnalytics::setCompressionThreshold(int bytes)
+{
+    d->core.setCompressionThreshold(bytes);
+}
+
+int GAnalytics::compressionThreshold() const
+{
+    return d->core.compressionThreshold();
+}
+
+void GAnalytics::setAdaptiveDispatch(bool enabled)
+{
+    d->core.setAdaptiveDispatch(enabled);
+}
+
+bool GAnalytics::adaptiveDispatch() const
+{
+    return d->core.adaptiveDispatch();
+}
+
+void GAnalytics::setCompressPersistedMessages(bool enabled)
+{
+    d->core.setCompressPersistedMessages(enabled);
+}
+
+bool GAnalytics::compressPersistedMessages() const
+{
+    return d->core.compressPersistedMessages();
+}
+
+void GAnalytics::setDispatchBounds(int minHitsPerPost, int maxHitsPerPost, int minPosts, int maxPosts)
+{
+    d->core.setDispatchBounds(minHitsPerPost, maxHitsPerPost, minPosts, maxPosts);
+}
+
+QString GAnalytics::sharedSpoolDirectory() const
+{
+    return d->spool ? d->spool->directory() : QString();
+}
+
+QVariantList GAnalytics::deadLetters() const
+{
+    QVariantList list;
+    foreach (const GAnalyticsCore::DeadLetter &letter, d->core.deadLetters())
+    {
+        QVariantMap entry;
+        entry.insert("message", letter.message);
+        entry.insert("httpStatus", letter.httpStatus);
+        entry.insert("reason", letter.reason);
+        entry.insert("time", QDateTime::fromMSecsSinceEpoch(letter.time));
+        list << entry;
+    }
+
+    return list;
+}
+
+void GAnalytics::clearDeadLetters()
+{
+    d->core.clearDeadLetters();
+}
 
 /**
 * SentAppview is called when the user changed the applications view.
@@ -709,17 +871,21 @@ void GAnalytics::sendAppView(const QString &screenName,
  * @param screenName
  */
 void GAnalytics::sendScreenView(const QString &screenName,
-                                const QVariantMap &customValues)
+                                const QVariantMap &customValues,
+                                Priority priority)
 {
     d->logMessage(Info, QString("ScreenView: %1").arg(screenName));
 
-    QUrlQuery query = d->buildStandardPostQuery("screenview");
-    query.addQueryItem("cd", screenName);
-    query.addQueryItem("an", d->appName);
-    query.addQueryItem("av", d->appVersion);
-    appendCustomValues(query, customValues);
+    if (customValues.isEmpty())
+    {
+        d->enqueQueryWithCurrentTime(d->core.encodeScreenView(screenName), priority);
+        return;
+    }
+
+    QUrlQuery query = d->core.buildScreenViewQuery(screenName);
+    GAnalyticsCore::appendCustomValues(query, customValues);
 
-    d->enqueQueryWithCurrentTime(query);
+    d->enqueQueryWithCurrentTime(query, priority);
 }
 
 /**
@@ -730,54 +896,139 @@ void GAnalytics::sendScreenView(const QString &screenName,
  * @param eventAction
  * @param eventLabel
  * @param eventValue
+ * @param priority
  */
 void GAnalytics::sendEvent(const QString &category, const QString &action,
                            const QString &label, const QVariant &value,
-                           const QVariantMap &customValues)
+                           const QVariantMap &customValues,
+                           Priority priority)
 {
-    QUrlQuery query = d->buildStandardPostQuery("event");
-    query.addQueryItem("an", d->appName);
-    query.addQueryItem("av", d->appVersion);
-    query.addQueryItem("ec", category);
-    query.addQueryItem("ea", action);
-    if (! label.isEmpty())
-        query.addQueryItem("el", label);
-    if (value.isValid())
-        query.addQueryItem("ev", value.toString());
+    QUrlQuery query = d->core.buildEventQuery(category, action, label, value);
+    GAnalyticsCore::appendCustomValues(query, customValues);
 
-    appendCustomValues(query, customValues);
+    d->enqueQueryWithCurrentTime(query, priority);
+}
 
-    d->enqueQueryWithCurrentTime(query);
+/**
+ * Register the fixed part of an event. The category, action and
+ * custom values are encoded once, together with the app name and
+ * version at the time of registration.
+ * @param category
+ * @param action
+ * @param customValues
+ * @return handle       For sendEventTemplate().
+ */
+int GAnalytics::registerEventTemplate(const QString &category, const QString &action,
+                                      const QVariantMap &customValues)
+{
+    return d->core.registerEventTemplate(category, action, customValues);
+}
+
+/**
+ * Send an event registered with registerEventTemplate(). Only the
+ * label, the value and the varying custom values are encoded.
+ * @param handle
+ * @param label
+ * @param value
+ * @param varyingValues Custom dimensions and metrics which differ per event.
+ * @param priority
+ */
+void GAnalytics::sendEventTemplate(int handle, const QString &label, const QVariant &value,
+                                   const QVariantMap &varyingValues, Priority priority)
+{
+    d->enqueQueryWithCurrentTime(d->core.buildFromEventTemplate(handle, label, value, varyingValues), priority);
 }
 
 /**
  * Method is called after an exception was raised. It builds a
  * query for a POST message. These query will be stored in a
- * message queue.
+ * message queue. Fatal exceptions are always sent urgently.
  * @param exceptionDescription
  * @param exceptionFatal
+ * @param priority
  */
 void GAnalytics::sendException(const QString &exceptionDescription,
                                bool exceptionFatal,
-                               const QVariantMap &customValues)
+                               const QVariantMap &customValues,
+                               Priority priority)
 {
-    QUrlQuery query = d->buildStandardPostQuery("exception");
-    query.addQueryItem("an", d->appName);
-    query.addQueryItem("av", d->appVersion);
+    QUrlQuery query = d->core.buildExceptionQuery(exceptionDescription, exceptionFatal);
+    GAnalyticsCore::appendCustomValues(query, customValues);
 
-    query.addQueryItem("exd", exceptionDescription);
+    d->enqueQueryWithCurrentTime(query, exceptionFatal ? Urgent : priority);
+}
 
-    if (exceptionFatal)
+/**
+ * Report how long something took (a user timing). The query is
+ * stored in the message queue like all other messages. With timing
+ * aggregation enabled, the duration is only counted in the histogram
+ * of its category and variable; label, custom values and priority
+ * are dropped.
+ * @param category
+ * @param variable
+ * @param milliseconds
+ * @param label
+ * @param priority
+ */
+void GAnalytics::sendTiming(const QString &category, const QString &variable,
+                            int milliseconds, const QString &label,
+                            const QVariantMap &customValues,
+                            Priority priority)
+{
+    if (d->aggregateTimings.loadAcquire())
     {
-        query.addQueryItem("exf", "1");
+        if (!customValues.isEmpty() && d->core.logLevel() <= GAnalyticsCore::Debug)
+        {
+            d->logMessage(Debug, QString("Timing %1/%2 aggregated, custom values discarded").arg(category, variable));
+        }
+        if (!d->histograms.record(category, variable, milliseconds))
+        {
+            d->droppedTimings.fetchAndAddRelaxed(1);
+        }
+        return;
     }
-    else
+
+    QUrlQuery query = d->core.buildTimingQuery(category, variable, milliseconds, label);
+    GAnalyticsCore::appendCustomValues(query, customValues);
+
+    d->enqueQueryWithCurrentTime(query, priority);
+}
+
+/**
+ * Start measuring. Only reads the monotonic clock.
+ * @param tracker       Receives the timing, may be NULL to measure nothing.
+ * @param category
+ * @param variable
+ * @param label
+ */
+GAnalytics::ScopedTiming::ScopedTiming(GAnalytics *tracker, const QString &category,
+                                       const QString &variable, const QString &label)
+: tracker(tracker)
+, category(category)
+, variable(variable)
+, label(label)
+{
+    timer.start();
+}
+
+/**
+ * Send the time elapsed since construction.
+ */
+GAnalytics::ScopedTiming::~ScopedTiming()
+{
+    if (tracker)
     {
-        query.addQueryItem("exf", "0");
+        tracker->sendTiming(category, variable, int(timer.elapsed()), label);
     }
-    appendCustomValues(query, customValues);
+}
 
-    d->enqueQueryWithCurrentTime(query);
+/**
+ * Do not send anything when going out of scope,
+ * e.g. if the measured operation failed.
+ */
+void GAnalytics::ScopedTiming::cancel()
+{
+    tracker = NULL;
 }
 
 /**
@@ -804,6 +1055,168 @@ void GAnalytics::endSession()
 	sendEvent("Session", "End", QString(), QVariant(), customValues);
 }
 
+/**
+ * Replace the reachability probe. Ownership is taken.
+ * @param reachability  NULL for the platform's probe.
+ */
+void GAnalytics::Private::setReachability(GAnalyticsReachability *reachability)
+{
+    if (this->reachability == reachability)
+    {
+        return;
+    }
+
+    if (!reachability)
+    {
+        reachability = new GAnalyticsSystemReachability(this);
+    }
+
+    delete this->reachability;
+    this->reachability = reachability;
+    reachability->setParent(this);
+    connect(reachability, SIGNAL(onlineChanged(bool)), this, SLOT(onlineChanged(bool)));
+
+    onlineChanged(reachability->isOnline());
+}
+
+/**
+ * Suspend sending while offline. When the connection is back,
+ * the queue is sent right away in parallel batches.
+ * @param online
+ */
+void GAnalytics::Private::onlineChanged(bool online)
+{
+    if (isFlushing)
+    {
+        return;
+    }
+
+    if (!online)
+    {
+        logMessage(GAnalytics::Info, "Offline, sending suspended");
+        if (!isSending && !spool)
+        {
+            timer.stop();
+        }
+        return;
+    }
+
+    logMessage(GAnalytics::Info, "Online, sending resumed");
+    if (core.isEmpty() || currentReply || batchPosts > 0 || !canPost())
+    {
+        setIsSending(isSending);
+        return;
+    }
+
+    setIsSending(true);
+    batchFailed = false;
+    startBatchPosts();
+    if (batchPosts == 0)
+    {
+        setIsSending(throttleTimer.isActive());
+    }
+}
+
+/**
+ * Use a directory shared with other processes of the application.
+ * Only one process, the sender, uploads the messages of all of them.
+ * @param directory     An empty string stops sharing.
+ */
+void GAnalytics::Private::setSharedSpoolDirectory(const QString &directory)
+{
+    if ((spool ? spool->directory() : QString()) == directory)
+    {
+        return;
+    }
+
+    delete spool;
+    spool = directory.isEmpty() ? NULL : new GAnalyticsSharedSpool(directory);
+    setIsSending(isSending);
+}
+
+/**
+ * @return canPost      True if this process uploads messages now.
+ */
+bool GAnalytics::Private::canPost() const
+{
+    return reachability->isOnline() && (!spool || spool->isSender());
+}
+
+/**
+ * Hand queued messages to the sender through the shared spool.
+ * @param includeUrgent     Urgent messages are posted directly,
+ *                          except when shutting down.
+ * @return count            Number of spooled messages.
+ */
+int GAnalytics::Private::spoolMessages(bool includeUrgent)
+{
+    GANALYTICS_TRACE_SPAN("spoolMessages");
+
+    QList<GAnalyticsCore::Message> messages;
+    if (includeUrgent)
+    {
+        messages << core.take(GAnalyticsCore::Urgent);
+    }
+    messages << core.take(GAnalyticsCore::Normal);
+    messages << core.take(GAnalyticsCore::Bulk);
+
+    if (messages.isEmpty())
+    {
+        return 0;
+    }
+
+    if (!spool->write(core.persistMessages(messages)))
+    {
+        logMessage(GAnalytics::Error, QString("Could not write to %1").arg(spool->directory()));
+        core.requeue(messages);
+        return 0;
+    }
+
+    logMessage(GAnalytics::Debug, QString("%1 message(s) spooled").arg(messages.count()));
+    return messages.count();
+}
+
+/**
+ * Enqueue the messages other processes wrote into the shared spool.
+ */
+void GAnalytics::Private::collectSpool()
+{
+    GANALYTICS_TRACE_SPAN("collectSpool");
+
+    foreach (const QList<QString> &dataList, spool->takeFiles(maxSpoolFilesPerTick))
+    {
+        core.readMessages(dataList);
+    }
+}
+
+/**
+ * Called by the timer. With a shared spool, the process either
+ * collects the messages of the others (as sender) or hands its
+ * own messages over. If the sender is gone, the next process that
+ * gets here takes over.
+ */
+void GAnalytics::Private::timerTick()
+{
+    if (spool && !isFlushing)
+    {
+        if (!spool->isSender() && spool->tryBecomeSender())
+        {
+            logMessage(GAnalytics::Info, "Sending for all processes sharing the spool");
+        }
+
+        if (spool->isSender())
+        {
+            collectSpool();
+        }
+        else
+        {
+            spoolMessages(false);
+        }
+    }
+
+    postMessage();
+}
+
 /**
  * This function is called by a timer interval.
  * The function tries to send a messages from the queue.
@@ -816,48 +1229,40 @@ void GAnalytics::endSession()
  */
 void GAnalytics::Private::postMessage()
 {
-    if (messageQueue.isEmpty())
+    if (isFlushing || currentReply || batchPosts > 0)
     {
-        setIsSending(false);
         return;
     }
-    else
-    {
-        setIsSending(true);
-    }
 
-    QString connection = "close";
-    if (messageQueue.count() > 1)
+    if (!canPost())
     {
-        connection = "keep-alive";
+        if (!reachability->isOnline() && !core.isEmpty())
+        {
+            logMessage(GAnalytics::Info, QString("Offline, sending suspended, %1 message(s) queued").arg(core.count()));
+        }
+        setIsSending(false);
+        return;
     }
 
-    QueryBuffer buffer = messageQueue.head();
-    QDateTime sendTime = QDateTime::currentDateTime();
-    qint64 timeDiff = buffer.time.msecsTo(sendTime);
-
-    if(timeDiff > fourHours)
+    // The controller decides on batch size and parallel requests
+    if (core.adaptiveDispatch())
     {
-        // too old.
-        messageQueue.dequeue();
-        emit postNextMessage();
+        batchFailed = false;
+        startBatchPosts();
+        setIsSending(batchPosts > 0 || throttleTimer.isActive());
         return;
     }
 
-    buffer.postQuery.addQueryItem("qt", QString::number(timeDiff));
-    request.setRawHeader("Connection", connection.toUtf8());
-    QByteArray ba;
-    ba = buffer.postQuery.query(QUrl::FullyEncoded).toUtf8();
-    request.setHeader(QNetworkRequest::ContentLengthHeader, ba.length());
-
-    // Create a new network access manager if we don't have one yet
-    if (networkManager == NULL)
+    currentReply = postBatch(1);
+    if (currentReply == NULL)
     {
-        networkManager = new QNetworkAccessManager(this);
+        // Stay in sending state while waiting for the throttle.
+        setIsSending(throttleTimer.isActive());
+        return;
     }
 
-    QNetworkReply *reply = networkManager->post(request, ba);
-    connect(reply, SIGNAL(finished()), this, SLOT(postMessageFinished()));
+    setIsSending(true);
+    connect(currentReply, SIGNAL(finished()), this, SLOT(postMessageFinished()));
 }
 
 /**
@@ -872,24 +1277,323 @@ void GAnalytics::Private::postMessage()
 void GAnalytics::Private::postMessageFinished()
 {
     QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender());
-    reply->deleteLater();
+    currentReply = NULL;
 
-    int httpStausCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
-    if (httpStausCode < 200 || httpStausCode > 299)
+    if (finishPost(reply) == GAnalyticsCore::PostRetryable)
     {
-        logMessage(GAnalytics::Error, QString("Error posting message: %1").arg(reply->errorString()));
-
         // An error ocurred.
         setIsSending(false);
         return;
     }
+
+    emit postNextMessage();
+}
+
+/**
+ * Hand a finished post to the core, which counts, requeues
+ * or dead-letters its messages.
+ * @param reply
+ * @return result       How the post ended.
+ */
+GAnalyticsCore::PostResult GAnalytics::Private::finishPost(QNetworkReply *reply)
+{
+    GANALYTICS_TRACE_SPAN("finishPost");
+
+    reply->deleteLater();
+
+    int httpStatus = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    return core.finishBatch(inFlight.take(reply), httpStatus, reply->errorString());
+}
+
+/**
+ * Post the urgent lane right away, independent of the timer
+ * and of a regular post which may be running.
+ */
+void GAnalytics::Private::postUrgentMessages()
+{
+    if (isFlushing || !reachability->isOnline())
+    {
+        return;
+    }
+
+    QNetworkReply *reply = postBatch(GAnalyticsCore::maxHitsPerBatch, true);
+    if (reply)
+    {
+        connect(reply, SIGNAL(finished()), this, SLOT(urgentPostFinished()));
+    }
+}
+
+/**
+ * An urgent post has finished. On error the messages go back
+ * to the urgent lane, which the regular sending drains first.
+ */
+void GAnalytics::Private::urgentPostFinished()
+{
+    QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender());
+    finishPost(reply);
+}
+
+/**
+ * Create a network access manager if we don't have one yet.
+ * @return networkManager
+ */
+QNetworkAccessManager *GAnalytics::Private::getNetworkManager()
+{
+    if (networkManager == NULL)
+    {
+        networkManager = new QNetworkAccessManager(this);
+    }
+
+    return networkManager;
+}
+
+/**
+ * Take up to maxHits messages from the core and post them in one request.
+ * The messages are kept in inFlight until the reply has finished.
+ * If the throttle stopped the batch, the throttle timer is started.
+ * @param maxHits
+ * @param urgentOnly    Take messages from the urgent lane only.
+ * @return reply        The running request or NULL if there was nothing to send.
+ */
+QNetworkReply *GAnalytics::Private::postBatch(int maxHits, bool urgentOnly)
+{
+    GANALYTICS_TRACE_SPAN("postBatch");
+
+    GAnalyticsCore::Batch batch = core.takeBatch(maxHits, urgentOnly);
+
+    if (batch.throttleWait != 0 && !throttleTimer.isActive())
+    {
+        throttleTimer.start(batch.throttleWait > 0 ? int(batch.throttleWait) : timer.interval());
+    }
+
+    if (batch.isEmpty())
+    {
+        return NULL;
+    }
+
+    QNetworkRequest batchRequest(request);
+    batchRequest.setUrl(batch.url);
+    batchRequest.setRawHeader("Connection", core.isEmpty() ? "close" : "keep-alive");
+
+    // The body reads from the queued messages and lives as long as the reply.
+    GAnalyticsBatchBody *body = new GAnalyticsBatchBody(batch.messages, batch.sendTime);
+    QNetworkReply *reply;
+    QByteArray compressed;
+    if (core.compressBody(batch, body, &compressed))
+    {
+        delete body;
+        batchRequest.setRawHeader("Content-Encoding", "gzip");
+        batchRequest.setHeader(QNetworkRequest::ContentLengthHeader, compressed.size());
+        reply = getNetworkManager()->post(batchRequest, compressed);
+    }
     else
     {
-        logMessage(GAnalytics::Debug, "Message sent");
+        batchRequest.setHeader(QNetworkRequest::ContentLengthHeader, batch.size);
+        reply = getNetworkManager()->post(batchRequest, body);
+        body->setParent(reply);
     }
+    inFlight.insert(reply, batch);
 
-    messageQueue.dequeue();
-    emit postNextMessage();
+    return reply;
+}
+
+/**
+ * Abort all running posts and put their messages back into the queue.
+ * They keep their time stamps, so their queue time stays correct.
+ * @return count        Number of messages put back. The collector may have received them.
+ */
+int GAnalytics::Private::abortPosts()
+{
+    int count = 0;
+    QHashIterator<QNetworkReply*, GAnalyticsCore::Batch> iter(inFlight);
+    while (iter.hasNext())
+    {
+        iter.next();
+        disconnect(iter.key(), 0, this, 0);
+        iter.key()->abort();
+        iter.key()->deleteLater();
+        core.requeue(iter.value().messages);
+        count += iter.value().messages.count();
+    }
+    inFlight.clear();
+    currentReply = NULL;
+    batchPosts = 0;
+
+    return count;
+}
+
+/**
+ * Send as much of the queue as possible until the deadline expires.
+ * The regular sending is suspended meanwhile. Messages are combined
+ * into batch requests and several requests are posted in parallel.
+ * What could not be sent is written to the queue file and sent
+ * after the next start.
+ * @param deadline      Time budget for sending in milliseconds.
+ * @return result       Number of sent, persisted, unconfirmed and expired messages.
+ */
+GAnalytics::FlushResult GAnalytics::Private::flush(int deadline)
+{
+    GAnalytics::FlushResult result;
+    result.sent = 0;
+    result.persisted = 0;
+    result.unconfirmed = 0;
+    result.expired = 0;
+
+    if (summaryTimer.isActive())
+    {
+        publishTimingSummaries();
+    }
+
+    isFlushing = true;
+    timer.stop();
+
+    // Messages of running posts are sent again in a batch.
+    result.unconfirmed = abortPosts();
+
+    result.expired = core.removeExpired();
+
+    // Leave the sending to the sender of the shared spool.
+    if (spool && !spool->isSender())
+    {
+        result.persisted = spoolMessages(true);
+    }
+
+    if (deadline > 0 && !core.isEmpty() && canPost())
+    {
+        QEventLoop loop;
+        QTimer deadlineTimer;
+        deadlineTimer.setSingleShot(true);
+        connect(&deadlineTimer, SIGNAL(timeout()), &loop, SLOT(quit()));
+        deadlineTimer.start(deadline);
+
+        flushLoop = &loop;
+        batchFailed = false;
+        int sentBefore = core.sentCount();
+
+        startBatchPosts();
+        if (batchPosts > 0 || throttleTimer.isActive())
+        {
+            loop.exec();
+        }
+
+        // Deadline expired. Everything still on the way is persisted.
+        result.unconfirmed += abortPosts();
+        flushLoop = NULL;
+
+        result.sent = core.sentCount() - sentBefore;
+    }
+
+    if (!core.isEmpty())
+    {
+        int count = core.count() + core.backlogCount();
+
+        // Keep what an earlier flush persisted and nobody restored since.
+        restorePersistedQueue();
+
+        // Written page by page, the backlog is not loaded into memory
+        QString fileName = queueFileName();
+        QDir().mkpath(QFileInfo(fileName).absolutePath());
+        QSaveFile file(fileName);
+        if (file.open(QIODevice::WriteOnly))
+        {
+            QDataStream outStream(&file);
+            outStream.setVersion(QDataStream::Qt_5_0);
+            core.writeMessages(outStream);
+        }
+
+        if (file.commit())
+        {
+            result.persisted += count;
+        }
+        else
+        {
+            logMessage(GAnalytics::Error, QString("Could not write %1, %2 message(s) lost").arg(fileName).arg(count));
+            result.unconfirmed = 0;
+        }
+        core.clear();
+    }
+
+    logMessage(GAnalytics::Info, QString("Flush: %1 sent, %2 persisted (%3 unconfirmed), %4 expired")
+               .arg(result.sent).arg(result.persisted).arg(result.unconfirmed).arg(result.expired));
+
+    isFlushing = false;
+    setIsSending(false);
+
+    return result;
+}
+
+/**
+ * Post batches from the head of the queue until the
+ * number of parallel requests is reached. Used by flush()
+ * and to catch up after the connection came back.
+ */
+void GAnalytics::Private::startBatchPosts()
+{
+    const GAnalyticsCongestionControl &control = core.congestionControl();
+    int maxPosts = core.adaptiveDispatch() ? control.concurrentPosts() : maxFlushPosts;
+
+    while (!batchFailed && batchPosts < maxPosts && canPost())
+    {
+        QNetworkReply *reply = postBatch(core.hitsPerPost());
+        if (reply == NULL)
+        {
+            break;
+        }
+
+        connect(reply, SIGNAL(finished()), this, SLOT(batchPostFinished()));
+        ++batchPosts;
+    }
+}
+
+/**
+ * A batch has finished. The next batches are posted unless
+ * a network or server error occurred. When the last batch
+ * has finished, the flush returns or the regular sending
+ * takes over again.
+ */
+void GAnalytics::Private::batchPostFinished()
+{
+    QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender());
+    --batchPosts;
+
+    if (finishPost(reply) == GAnalyticsCore::PostRetryable)
+    {
+        batchFailed = true;
+    }
+
+    startBatchPosts();
+
+    if (batchPosts > 0 || (flushLoop && throttleTimer.isActive()))
+    {
+        return;
+    }
+
+    if (flushLoop)
+    {
+        flushLoop->quit();
+    }
+    else
+    {
+        setIsSending(throttleTimer.isActive());
+    }
+}
+
+/**
+ * The throttle has tokens again. Continue the flush or the regular sending.
+ */
+void GAnalytics::Private::throttleExpired()
+{
+    if (!flushLoop)
+    {
+        postMessage();
+        return;
+    }
+
+    startBatchPosts();
+    if (batchPosts == 0 && !throttleTimer.isActive())
+    {
+        flushLoop->quit();
+    }
 }
 
 
@@ -901,7 +1605,7 @@ void GAnalytics::Private::postMessageFinished()
  */
 QDataStream &operator<<(QDataStream &outStream, const GAnalytics &analytics)
 {
-    outStream << analytics.d->persistMessageQueue();
+    analytics.d->core.writeMessages(outStream);
 
     return outStream;
 }
@@ -915,9 +1619,7 @@ QDataStream &operator<<(QDataStream &outStream, const GAnalytics &analytics)
  */
 QDataStream &operator >>(QDataStream &inStream, GAnalytics &analytics)
 {
-    QList<QString> dataList;
-    inStream >> dataList;
-    analytics.d->readMessagesFromFile(dataList);
+    analytics.d->core.readMessages(inStream);
 
     return inStream;
 }
@@ -936,7 +1638,11 @@ void GAnalytics::classBegin()
 
 void GAnalytics::componentComplete()
 {
+    GAnalyticsAttached::setDefaultTracker(this);
 }
-#endif // QT_QML_LIB
 
-#include "ganalytics.moc"
+GAnalyticsAttached *GAnalytics::qmlAttachedProperties(QObject *object)
+{
+    return new GAnalyticsAttached(object);
+}
+#endif // QT_QML_LIB
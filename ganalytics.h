@@ -1,14 +1,20 @@
 #ifndef GANALYTICS_H
 #define GANALYTICS_H
 
+#include <QElapsedTimer>
 #include <QObject>
 #include <QVariantMap>
 
 #ifdef QT_QML_LIB
 #include <QQmlParserStatus>
+#include <qqml.h>
+
+#include "ganalyticsattached.h"
 #endif // QT_QML_LIB
 
 class QNetworkAccessManager;
+class GAnalyticsReachability;
+class GAnalyticsSettingsStore;
 
 class GAnalytics : public QObject
 #ifdef QT_QML_LIB
@@ -18,8 +24,11 @@ class GAnalytics : public QObject
     Q_OBJECT
 #ifdef QT_QML_LIB
     Q_INTERFACES(QQmlParserStatus)
+#if QT_VERSION >= QT_VERSION_CHECK(5, 15, 0)
+    QML_ATTACHED(GAnalyticsAttached)
+#endif
 #endif // QT_QML_LIB
-    Q_ENUMS(LogLevel)
+    Q_ENUMS(LogLevel Priority)
     Q_PROPERTY(LogLevel logLevel READ logLevel WRITE setLogLevel NOTIFY logLevelChanged)
     Q_PROPERTY(QString viewportSize READ viewportSize WRITE setViewportSize NOTIFY viewportSizeChanged)
     Q_PROPERTY(QString language READ language WRITE setLanguage NOTIFY languageChanged)
@@ -34,6 +43,7 @@ public:
     ~GAnalytics();
 
 public:
+    // Same values as in GAnalyticsCore
     enum LogLevel
     {
         Debug,
@@ -42,6 +52,13 @@ public:
         None
     };
 
+    enum Priority
+    {
+        Urgent,     ///< Posted immediately and sent before anything else, e.g. fatal exceptions
+        Normal,
+        Bulk        ///< Messages restored from a previous run
+    };
+
     void setLogLevel(LogLevel logLevel);
     LogLevel logLevel() const;
 
@@ -64,29 +81,147 @@ public:
     void startSending();
     bool isSending() const;
 
+    struct FlushResult
+    {
+        int sent;           ///< Messages delivered during the flush
+        int persisted;      ///< Messages written to the queue file, sent after the next start
+        int unconfirmed;    ///< Persisted messages whose post was aborted. The collector may have received
+                            ///< them, so they may arrive twice: delivery is at least once.
+        int expired;        ///< Messages dropped because they were too old to be sent
+    };
+
+    /// Count timings in local histograms instead of sending each one. Every interval milliseconds, count,
+    /// p50, p90, p99 and max are sent per category and variable. 0 (the default) sends every timing.
+    /// While enabled, sendTiming() and ScopedTiming may be used from any thread. Only the duration is
+    /// counted: the label, custom values and priority of each timing are discarded. Change the interval
+    /// only while no other thread records timings.
+    void setTimingAggregationInterval(int milliseconds);
+    int timingAggregationInterval() const;
+
+    /// Measures the time until it goes out of scope and sends it with sendTiming().
+    /// Costs one clock read on construction and one on destruction besides queueing the message.
+    class ScopedTiming
+    {
+    public:
+        ScopedTiming(GAnalytics *tracker, const QString &category, const QString &variable,
+                     const QString &label = QString());
+        ~ScopedTiming();
+
+        void cancel();
+
+    private:
+        Q_DISABLE_COPY(ScopedTiming)
+
+        GAnalytics *tracker;
+        QString category;
+        QString variable;
+        QString label;
+        QElapsedTimer timer;
+    };
+
+    /// Send queued messages until the deadline (in milliseconds) expires and persist the rest.
+    /// Blocks while sending. Call it before shutting down. Backlog read with operator>> which
+    /// has not been loaded yet is not touched; write it with operator<< as before.
+    FlushResult flush(int deadline = 2000);
+
     /// Get or set the network access manager. If none is set, the class creates its own on the first request
     void setNetworkAccessManager(QNetworkAccessManager *networkAccessManager);
     QNetworkAccessManager *networkAccessManager() const;
 
+    /// Get or set the store for persisted values like the client id. Reads are served from memory,
+    /// writes are batched onto a background thread. Defaults to QSettings. Takes ownership.
+    void setSettingsStore(GAnalyticsSettingsStore *store);
+    GAnalyticsSettingsStore *settingsStore() const;
+
+    /// Get or set the probe telling whether the collector can be reached. Sending is suspended
+    /// while offline. Defaults to the platform's network information, which NULL restores. Takes ownership.
+    void setReachability(GAnalyticsReachability *reachability);
+    GAnalyticsReachability *reachability() const;
+
+    /// Limit the rate of messages per tracking id like the collector does: up to burst messages at once,
+    /// refilled at messagesPerSecond. Messages above the limit are delayed, not dropped. A burst or rate of 0
+    /// disables the limit.
+    void setRateLimit(int burst, double messagesPerSecond);
+    int rateLimitBurst() const;
+    double rateLimitPerSecond() const;
+
+    /// Post to another host than Google Analytics, e.g. a relay. Messages go to its collect and batch paths.
+    void setEndpoint(const QUrl &endpoint);
+    QUrl endpoint() const;
+
+    /// Gzip request bodies of at least this many bytes, for endpoints accepting Content-Encoding gzip.
+    /// Needs a build with CONFIG += ganalytics_gzip. 0 disables, which is the default.
+    void setCompressionThreshold(int bytes);
+    int compressionThreshold() const;
+
+    /// Adapt the hits per request and the parallel requests to the measured round trip times, errors
+    /// and throughput (AIMD). Off by default: single hits one at a time, fixed batches when catching up.
+    void setAdaptiveDispatch(bool enabled);
+    bool adaptiveDispatch() const;
+
+    /// Compress the pages written by operator<<, i.e. store the longest common prefix of the
+    /// messages once per page and deflate the rest. On by default. stats() reports persistedBytesPer10k to compare.
+    void setCompressPersistedMessages(bool enabled);
+    bool compressPersistedMessages() const;
+
+    /// Bounds of the adaptive dispatch. Defaults to 1-20 hits per request and 1-8 parallel requests.
+    void setDispatchBounds(int minHitsPerPost, int maxHitsPerPost, int minPosts, int maxPosts);
+
+    /// Share a machine-local directory with other processes of the application. Each process writes
+    /// its messages there, one process elected through a lock file sends them all. Empty to disable.
+    void setSharedSpoolDirectory(const QString &directory);
+    QString sharedSpoolDirectory() const;
+
+    /// Counters describing the state of the tracker, e.g. the number of queued messages per priority
+    Q_INVOKABLE QVariantMap stats() const;
+
+    /// Messages the collector refused permanently (HTTP 4xx) or which were too large to send.
+    /// Only the latest 100 are kept. Each entry holds message, httpStatus, reason and time.
+    Q_INVOKABLE QVariantList deadLetters() const;
+    Q_INVOKABLE void clearDeadLetters();
+
+    /// Register an event sent often with the same category, action and custom values. These are
+    /// encoded once; sendEventTemplate() only encodes what varies. Returns the handle of the template.
+    Q_INVOKABLE int registerEventTemplate(const QString &category,
+                                          const QString &action,
+                                          const QVariantMap &customValues = QVariantMap());
+
 #ifdef QT_QML_LIB
     // QQmlParserStatus interface
     void classBegin();
     void componentComplete();
+
+    /// Tracker.screenName and Tracker.tracker on QML items, see GAnalyticsAttached.
+    static GAnalyticsAttached *qmlAttachedProperties(QObject *object);
 #endif // QT_QML_LIB
 
 public slots:
     void sendScreenView(const QString &screenName,
-                        const QVariantMap &customValues = QVariantMap());
+                        const QVariantMap &customValues = QVariantMap(),
+                        Priority priority = Normal);
     void sendAppView(const QString &screenName,
                      const QVariantMap &customValues = QVariantMap());
     void sendEvent(const QString &category,
                    const QString &action,
                    const QString &label = QString(),
                    const QVariant &value = QVariant(),
-                   const QVariantMap &customValues = QVariantMap());
+                   const QVariantMap &customValues = QVariantMap(),
+                   Priority priority = Normal);
     void sendException(const QString &exceptionDescription,
                        bool exceptionFatal = true,
-                       const QVariantMap &customValues = QVariantMap());
+                       const QVariantMap &customValues = QVariantMap(),
+                       Priority priority = Normal);
+    void sendTiming(const QString &category,
+                    const QString &variable,
+                    int milliseconds,
+                    const QString &label = QString(),
+                    const QVariantMap &customValues = QVariantMap(),
+                    Priority priority = Normal);
+    void sendEventTemplate(int handle,
+                           const QString &label = QString(),
+                           const QVariant &value = QVariant(),
+                           const QVariantMap &varyingValues = QVariantMap(),
+                           Priority priority = Normal);
     void startSession();
     void endSession();
 
@@ -111,4 +246,8 @@ private:
 QDataStream& operator<<(QDataStream &outStream, const GAnalytics &analytics);
 QDataStream& operator>>(QDataStream &inStream, GAnalytics &analytics);
 
+#if defined(QT_QML_LIB) && QT_VERSION < QT_VERSION_CHECK(5, 15, 0)
+QML_DECLARE_TYPEINFO(GAnalytics, QML_HAS_ATTACHED_PROPERTIES)
+#endif
+
 #endif // GANALYTICS_H
@@ -0,0 +1,116 @@
+#ifndef GANALYTICS_P_H
+#define GANALYTICS_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the public API. It exposes the internals of
+// GAnalytics to tools which drive the dispatch logic directly, like the
+// dispatch simulator. It may change from version to version.
+//
+
+#include "ganalytics.h"
+#include "ganalyticscore.h"
+#include "ganalyticshistogram.h"
+#include "ganalyticssettings.h"
+
+#include <QEventLoop>
+#include <QHash>
+#include <QNetworkRequest>
+#include <QTimer>
+#include <QUrlQuery>
+
+class GAnalyticsSharedSpool;
+class QNetworkReply;
+
+/**
+ * Class Private
+ * Private members and functions.
+ */
+class GAnalytics::Private : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit Private(GAnalytics *parent = 0);
+    ~Private();
+
+    static Private *get(GAnalytics *tracker) { return tracker->d; }
+
+    GAnalytics *q;
+
+    QNetworkAccessManager *networkManager;
+    QNetworkReply *currentReply;
+    GAnalyticsReachability *reachability;
+    GAnalyticsSharedSpool *spool;
+    GAnalyticsSettings settings;
+
+    GAnalyticsCore core;
+    QHash<QNetworkReply*, GAnalyticsCore::Batch> inFlight;
+    QTimer timer;
+    QNetworkRequest request;
+
+    bool isSending;
+
+    bool isFlushing;
+    bool batchFailed;
+    int batchPosts;
+    QEventLoop *flushLoop;
+
+    QTimer throttleTimer;
+
+    GAnalyticsHistogramTable histograms;
+    QAtomicInt aggregateTimings;
+    QAtomicInt droppedTimings;
+    QTimer summaryTimer;
+
+    const static int maxSpoolFilesPerTick = 50;
+    const static int maxFlushPosts = 4;
+    const static QString queueKey;
+
+public:
+    void logMessage(GAnalytics::LogLevel level, const QString &message);
+
+#ifdef QT_GUI_LIB
+    QString getScreenResolution();
+#endif // QT_GUI_LIB
+    QString getUserAgent();
+    QString getSystemInfo();
+    QString getClientID();
+    QString getUserID();
+    void setUserID(const QString &userID);
+    void setSettingsStore(GAnalyticsSettingsStore *store);
+    void restorePersistedQueue();
+    QString queueFileName() const;
+    void enqueQueryWithCurrentTime(const QUrlQuery &query, GAnalytics::Priority priority);
+    void enqueQueryWithCurrentTime(const QByteArray &encodedQuery, GAnalytics::Priority priority);
+    void setIsSending(bool doSend);
+    void setReachability(GAnalyticsReachability *reachability);
+    void setSharedSpoolDirectory(const QString &directory);
+    bool canPost() const;
+    int spoolMessages(bool includeUrgent);
+    void collectSpool();
+    QNetworkAccessManager *getNetworkManager();
+    QNetworkReply *postBatch(int maxHits, bool urgentOnly = false);
+    int abortPosts();
+    GAnalyticsCore::PostResult finishPost(QNetworkReply *reply);
+    void postUrgentMessages();
+    GAnalytics::FlushResult flush(int deadline);
+    void startBatchPosts();
+
+signals:
+    void postNextMessage();
+
+public slots:
+    void timerTick();
+    void postMessage();
+    void postMessageFinished();
+    void urgentPostFinished();
+    void batchPostFinished();
+    void onlineChanged(bool online);
+    void throttleExpired();
+    void publishTimingSummaries();
+};
+
+#endif // GANALYTICS_P_H
@@ -0,0 +1,127 @@
+#include "ganalyticsattached.h"
+#include "ganalytics.h"
+
+#include <QMetaObject>
+
+QPointer<GAnalytics> GAnalyticsAttached::defaultTracker;
+
+/**
+ * Constructor
+ * Follows the visibility of the object, if it is an item.
+ * @param object        The object the properties are attached to.
+ */
+GAnalyticsAttached::GAnalyticsAttached(QObject *object)
+: QObject(object)
+, hasVisibility(false)
+, updatePending(false)
+{
+    if (object->metaObject()->indexOfSignal("visibleChanged()") >= 0)
+    {
+        hasVisibility = connect(object, SIGNAL(visibleChanged()), this, SLOT(visibleChanged()));
+    }
+}
+
+/**
+ * Set the name the page is reported with. The name is kept as
+ * it is, the tracker encodes each screen name only once.
+ * @param screenName
+ */
+void GAnalyticsAttached::setScreenName(const QString &screenName)
+{
+    if (name != screenName)
+    {
+        name = screenName;
+        emit screenNameChanged();
+        scheduleUpdate();
+    }
+}
+
+QString GAnalyticsAttached::screenName() const
+{
+    return name;
+}
+
+void GAnalyticsAttached::setTracker(GAnalytics *tracker)
+{
+    if (explicitTracker != tracker)
+    {
+        explicitTracker = tracker;
+        emit trackerChanged();
+        scheduleUpdate();
+    }
+}
+
+GAnalytics *GAnalyticsAttached::tracker() const
+{
+    return explicitTracker ? explicitTracker.data() : defaultTracker.data();
+}
+
+void GAnalyticsAttached::setTrackerObject(QObject *tracker)
+{
+    setTracker(qobject_cast<GAnalytics*>(tracker));
+}
+
+QObject *GAnalyticsAttached::trackerObject() const
+{
+    return tracker();
+}
+
+/**
+ * Set the tracker pages report to when they do not name one.
+ * The first call wins.
+ * @param tracker
+ */
+void GAnalyticsAttached::setDefaultTracker(GAnalytics *tracker)
+{
+    if (!defaultTracker)
+    {
+        defaultTracker = tracker;
+    }
+}
+
+void GAnalyticsAttached::visibleChanged()
+{
+    if (!parent()->property("visible").toBool())
+    {
+        reported.clear();
+    }
+    scheduleUpdate();
+}
+
+/**
+ * Check the page once the current changes are done. A page which is
+ * created and hidden right away, like the pages below the top of a
+ * StackView, is not reported.
+ */
+void GAnalyticsAttached::scheduleUpdate()
+{
+    if (!updatePending)
+    {
+        updatePending = true;
+        QMetaObject::invokeMethod(this, "update", Qt::QueuedConnection);
+    }
+}
+
+/**
+ * Send a screen view if the page is visible and was not
+ * reported under its current name since it became visible.
+ */
+void GAnalyticsAttached::update()
+{
+    updatePending = false;
+
+    if (hasVisibility && !parent()->property("visible").toBool())
+    {
+        reported.clear();
+        return;
+    }
+
+    GAnalytics *screenTracker = tracker();
+    if (name.isEmpty() || name == reported || !screenTracker)
+    {
+        return;
+    }
+
+    screenTracker->sendScreenView(name);
+    reported = name;
+}
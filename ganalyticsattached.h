@@ -0,0 +1,62 @@
+#ifndef GANALYTICSATTACHED_H
+#define GANALYTICSATTACHED_H
+
+#include <QObject>
+#include <QPointer>
+#include <QString>
+
+class GAnalytics;
+
+/**
+ * Attached properties of the QML Tracker type. A page declares its
+ * screen name once and the screen view is sent from C++ whenever the
+ * page becomes visible, e.g. when a StackView pushes it or pops back
+ * to it, or when a Loader loads it:
+ *
+ *     Item {
+ *         Tracker.screenName: "Settings"
+ *     }
+ *
+ * The screen view goes to the given tracker or, if none is given, to
+ * the first Tracker created in QML.
+ */
+class GAnalyticsAttached : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(QString screenName READ screenName WRITE setScreenName NOTIFY screenNameChanged)
+    // A QObject, so that this header does not need the declaration of GAnalytics
+    Q_PROPERTY(QObject *tracker READ trackerObject WRITE setTrackerObject NOTIFY trackerChanged)
+
+public:
+    explicit GAnalyticsAttached(QObject *object);
+
+    void setScreenName(const QString &screenName);
+    QString screenName() const;
+    void setTracker(GAnalytics *tracker);
+    GAnalytics *tracker() const;
+    void setTrackerObject(QObject *tracker);
+    QObject *trackerObject() const;
+
+    static void setDefaultTracker(GAnalytics *tracker);
+
+signals:
+    void screenNameChanged();
+    void trackerChanged();
+
+private slots:
+    void visibleChanged();
+    void update();
+
+private:
+    void scheduleUpdate();
+
+    static QPointer<GAnalytics> defaultTracker;
+
+    QString name;
+    QString reported;                   ///< Screen name sent since the item became visible
+    QPointer<GAnalytics> explicitTracker;
+    bool hasVisibility;
+    bool updatePending;
+};
+
+#endif // GANALYTICSATTACHED_H
@@ -0,0 +1,305 @@
+#include "ganalyticsbacklog.h"
+
+#include <QBuffer>
+
+GAnalyticsBacklog::GAnalyticsBacklog()
+: messageCount(0)
+{
+}
+
+/**
+ * Copy the pages of a stream into the backlog. The stream must be
+ * positioned behind the magic number and version. Reading stops at
+ * the end marker.
+ * @param inStream
+ * @param streamVersion Format version read from the stream.
+ * @param oldest        Pages whose newest message is older than this are skipped.
+ * @param unreadable    Set to the number of messages skipped because their page has an unknown encoding.
+ * @return count        Number of messages added.
+ */
+int GAnalyticsBacklog::readPages(QDataStream &inStream, quint32 streamVersion, qint64 oldest, int *unreadable)
+{
+    if (unreadable)
+    {
+        *unreadable = 0;
+    }
+
+    if (!file.isOpen() && !file.open())
+    {
+        return 0;
+    }
+
+    int added = 0;
+    while (inStream.status() == QDataStream::Ok)
+    {
+        Page page;
+        inStream >> page.count;
+        if (page.count == 0)
+        {
+            break;
+        }
+        inStream >> page.anchor >> page.newest;
+        page.encoding = Plain;
+        if (streamVersion >= 2)
+        {
+            inStream >> page.encoding;
+        }
+        inStream >> page.length;
+
+        if (page.encoding > Compressed)
+        {
+            // Written by a newer version. The pages after it may still be readable.
+            inStream.skipRawData(page.length);
+            if (unreadable)
+            {
+                *unreadable += page.count;
+            }
+            continue;
+        }
+
+        if (page.newest < oldest)
+        {
+            inStream.skipRawData(page.length);
+            continue;
+        }
+
+        QByteArray payload(page.length, Qt::Uninitialized);
+        if (inStream.readRawData(payload.data(), page.length) != int(page.length))
+        {
+            break;
+        }
+
+        page.offset = file.size();
+        file.seek(page.offset);
+        if (file.write(payload) != payload.size())
+        {
+            break;
+        }
+
+        pages << page;
+        messageCount += page.count;
+        added += page.count;
+    }
+
+    return added;
+}
+
+/**
+ * Copy all pages to a stream without decoding them.
+ * @param outStream
+ * @return bytes        Number of bytes written.
+ */
+qint64 GAnalyticsBacklog::writePages(QDataStream &outStream)
+{
+    qint64 written = 0;
+    foreach (const Page &page, pages)
+    {
+        file.seek(page.offset);
+        QByteArray payload = file.read(page.length);
+
+        outStream << page.count << page.anchor << page.newest << page.encoding << quint32(payload.size());
+        outStream.writeRawData(payload.constData(), payload.size());
+        written += pageHeaderSize + payload.size();
+    }
+
+    return written;
+}
+
+/**
+ * Decode and remove the oldest page.
+ * @param oldest        Messages older than this are skipped.
+ * @return records      The messages of the page.
+ */
+QList<GAnalyticsBacklog::Record> GAnalyticsBacklog::takePage(qint64 oldest)
+{
+    QList<Record> records;
+    if (pages.isEmpty())
+    {
+        return records;
+    }
+
+    Page page = pages.takeFirst();
+    messageCount -= page.count;
+
+    file.seek(page.offset);
+    QByteArray payload = file.read(page.length);
+    records = page.encoding == Compressed ? decodeCompressed(page, payload, oldest)
+                                          : decodePlain(page, payload, oldest);
+
+    if (pages.isEmpty())
+    {
+        file.resize(0);
+    }
+
+    return records;
+}
+
+/**
+ * Write messages as one page.
+ * @param outStream
+ * @param records
+ * @param encoding
+ * @return bytes        Number of bytes written.
+ */
+qint64 GAnalyticsBacklog::writePage(QDataStream &outStream, const QList<Record> &records, Encoding encoding)
+{
+    if (records.isEmpty())
+    {
+        return 0;
+    }
+
+    qint64 anchor = records.first().time;
+    qint64 newest = anchor;
+    foreach (const Record &record, records)
+    {
+        newest = qMax(newest, record.time);
+    }
+
+    QByteArray payload = encoding == Compressed ? encodeCompressed(records, anchor) : encodePlain(records, anchor);
+
+    outStream << quint32(records.count()) << anchor << newest << quint8(encoding) << quint32(payload.size());
+    outStream.writeRawData(payload.constData(), payload.size());
+
+    return pageHeaderSize + payload.size();
+}
+
+QByteArray GAnalyticsBacklog::encodePlain(const QList<Record> &records, qint64 anchor)
+{
+    QByteArray payload;
+    QBuffer buffer(&payload);
+    buffer.open(QIODevice::WriteOnly);
+    QDataStream pageStream(&buffer);
+    pageStream.setVersion(QDataStream::Qt_5_0);
+    foreach (const Record &record, records)
+    {
+        pageStream << qint64(record.time - anchor) << record.message;
+    }
+    buffer.close();
+
+    return payload;
+}
+
+/**
+ * Messages are url encoded, i.e. Latin-1. Their longest common
+ * prefix is stored once. Each record keeps its time offset and the
+ * rest of its message, and the whole page is deflated.
+ */
+QByteArray GAnalyticsBacklog::encodeCompressed(const QList<Record> &records, qint64 anchor)
+{
+    QList<QByteArray> messages;
+    foreach (const Record &record, records)
+    {
+        messages << record.message.toLatin1();
+    }
+
+    int prefixLength = messages.first().size();
+    foreach (const QByteArray &message, messages)
+    {
+        int length = 0;
+        while (length < prefixLength && length < message.size() && message.at(length) == messages.first().at(length))
+        {
+            ++length;
+        }
+        prefixLength = length;
+    }
+
+    QByteArray payload;
+    QBuffer buffer(&payload);
+    buffer.open(QIODevice::WriteOnly);
+    QDataStream pageStream(&buffer);
+    pageStream.setVersion(QDataStream::Qt_5_0);
+    pageStream << messages.first().left(prefixLength);
+    for (int i = 0; i < records.count(); ++i)
+    {
+        pageStream << qint64(records.at(i).time - anchor) << messages.at(i).mid(prefixLength);
+    }
+    buffer.close();
+
+    return qCompress(payload);
+}
+
+QList<GAnalyticsBacklog::Record> GAnalyticsBacklog::decodePlain(const Page &page, const QByteArray &payload,
+                                                                qint64 oldest)
+{
+    QList<Record> records;
+    QDataStream pageStream(payload);
+    pageStream.setVersion(QDataStream::Qt_5_0);
+
+    for (quint32 i = 0; i < page.count && pageStream.status() == QDataStream::Ok; ++i)
+    {
+        qint64 offset;
+        pageStream >> offset;
+
+        if (page.anchor + offset < oldest)
+        {
+            // Skip the serialized QString: its byte length followed by the data.
+            quint32 length;
+            pageStream >> length;
+            if (length != 0xFFFFFFFF)
+            {
+                pageStream.skipRawData(length);
+            }
+            continue;
+        }
+
+        Record record;
+        record.time = page.anchor + offset;
+        pageStream >> record.message;
+        records << record;
+    }
+
+    return records;
+}
+
+QList<GAnalyticsBacklog::Record> GAnalyticsBacklog::decodeCompressed(const Page &page, const QByteArray &payload,
+                                                                     qint64 oldest)
+{
+    QList<Record> records;
+    QDataStream pageStream(qUncompress(payload));
+    pageStream.setVersion(QDataStream::Qt_5_0);
+
+    QByteArray prefix;
+    pageStream >> prefix;
+
+    for (quint32 i = 0; i < page.count && pageStream.status() == QDataStream::Ok; ++i)
+    {
+        qint64 offset;
+        QByteArray rest;
+        pageStream >> offset >> rest;
+
+        if (page.anchor + offset < oldest)
+        {
+            continue;
+        }
+
+        Record record;
+        record.time = page.anchor + offset;
+        record.message = QString::fromLatin1(prefix + rest);
+        records << record;
+    }
+
+    return records;
+}
+
+/**
+ * Drop all pages.
+ */
+void GAnalyticsBacklog::clear()
+{
+    pages.clear();
+    messageCount = 0;
+    if (file.isOpen())
+    {
+        file.resize(0);
+    }
+}
+
+bool GAnalyticsBacklog::isEmpty() const
+{
+    return pages.isEmpty();
+}
+
+int GAnalyticsBacklog::count() const
+{
+    return messageCount;
+}
@@ -0,0 +1,79 @@
+#ifndef GANALYTICSBACKLOG_H
+#define GANALYTICSBACKLOG_H
+
+#include <QDataStream>
+#include <QList>
+#include <QString>
+#include <QTemporaryFile>
+
+/**
+ * Persisted messages which have not been loaded into the queue yet.
+ * The stream format is split into pages. Each page header carries the
+ * number of messages and the time of the newest one, so pages which are
+ * too old are skipped without decoding them. Pages read from a stream
+ * are copied as they are into a temporary file and decoded one at a
+ * time when the queue runs low.
+ *
+ * Since version 2 a page is either plain or compressed. A compressed
+ * page stores the longest common prefix of its messages once and
+ * deflates the remainders together. Every message starts with its
+ * standard parameters in the same order, so for a page of one hit
+ * type the prefix covers them all. Pages stay independent, so each
+ * one can still be skipped, loaded or dropped on its own.
+ */
+class GAnalyticsBacklog
+{
+public:
+    GAnalyticsBacklog();
+
+    struct Record
+    {
+        qint64 time;        ///< Wall clock time (UTC) in milliseconds since epoch
+        QString message;
+    };
+
+    enum Encoding
+    {
+        Plain,              ///< Time offset and message as QString per record, version 1 pages
+        Compressed          ///< Common prefix and time offsets and remainders as Latin-1, deflated
+    };
+
+    const static quint32 magic = 0x47415051;
+    const static quint32 version = 2;
+
+    int readPages(QDataStream &inStream, quint32 streamVersion, qint64 oldest, int *unreadable = NULL);
+    qint64 writePages(QDataStream &outStream);
+    QList<Record> takePage(qint64 oldest);
+    void clear();
+
+    static qint64 writePage(QDataStream &outStream, const QList<Record> &records, Encoding encoding);
+
+    bool isEmpty() const;
+    int count() const;
+
+private:
+    Q_DISABLE_COPY(GAnalyticsBacklog)
+
+    struct Page
+    {
+        qint64 offset;      ///< Position of the payload in the file
+        quint32 count;
+        qint64 anchor;      ///< Message times are relative to this time
+        qint64 newest;
+        quint8 encoding;
+        quint32 length;     ///< Size of the payload in bytes
+    };
+
+    const static int pageHeaderSize = 4 + 8 + 8 + 1 + 4;
+
+    static QList<Record> decodePlain(const Page &page, const QByteArray &payload, qint64 oldest);
+    static QList<Record> decodeCompressed(const Page &page, const QByteArray &payload, qint64 oldest);
+    static QByteArray encodePlain(const QList<Record> &records, qint64 anchor);
+    static QByteArray encodeCompressed(const QList<Record> &records, qint64 anchor);
+
+    QTemporaryFile file;
+    QList<Page> pages;
+    int messageCount;
+};
+
+#endif // GANALYTICSBACKLOG_H
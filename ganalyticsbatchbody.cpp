@@ -0,0 +1,89 @@
+#include "ganalyticsbatchbody.h"
+
+#include <algorithm>
+#include <cstring>
+
+/**
+ * Open a body over the given messages, one per line.
+ * @param messages
+ * @param sendTime      Time on the monotonic clock of the core the queue time is relative to.
+ * @param parent
+ */
+GAnalyticsBatchBody::GAnalyticsBatchBody(const QList<GAnalyticsCore::Message> &messages, qint64 sendTime,
+                                         QObject *parent)
+: QIODevice(parent)
+, total(0)
+{
+    segments.reserve(messages.count() * 2);
+    offsets.reserve(messages.count() * 2);
+
+    for (int i = 0; i < messages.count(); ++i)
+    {
+        QByteArray field = GAnalyticsCore::queueTimeField(messages.at(i), sendTime);
+        if (i + 1 < messages.count())
+        {
+            field += '\n';
+        }
+
+        offsets << total;
+        segments << messages.at(i).query;
+        total += messages.at(i).query.size();
+
+        offsets << total;
+        segments << field;
+        total += field.size();
+    }
+
+    open(QIODevice::ReadOnly);
+}
+
+bool GAnalyticsBatchBody::isSequential() const
+{
+    return false;
+}
+
+qint64 GAnalyticsBatchBody::size() const
+{
+    return total;
+}
+
+qint64 GAnalyticsBatchBody::readData(char *data, qint64 maxSize)
+{
+    qint64 position = pos();
+    if (position >= total)
+    {
+        return 0;
+    }
+
+    qint64 read = 0;
+    for (int segment = segmentAt(position); segment < segments.count() && read < maxSize; ++segment)
+    {
+        const QByteArray &bytes = segments.at(segment);
+        qint64 offset = position + read - offsets.at(segment);
+        qint64 length = qMin(bytes.size() - offset, maxSize - read);
+
+        memcpy(data + read, bytes.constData() + offset, size_t(length));
+        read += length;
+    }
+
+    return read;
+}
+
+qint64 GAnalyticsBatchBody::writeData(const char *data, qint64 maxSize)
+{
+    Q_UNUSED(data);
+    Q_UNUSED(maxSize);
+
+    return -1;
+}
+
+/**
+ * The segment containing a position of the body.
+ * @param position
+ * @return index
+ */
+int GAnalyticsBatchBody::segmentAt(qint64 position) const
+{
+    QVector<qint64>::const_iterator iter = std::upper_bound(offsets.begin(), offsets.end(), position);
+    return int(iter - offsets.begin()) - 1;
+}
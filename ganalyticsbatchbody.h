@@ -0,0 +1,37 @@
+#ifndef GANALYTICSBATCHBODY_H
+#define GANALYTICSBATCHBODY_H
+
+#include <QIODevice>
+#include <QVector>
+
+#include "ganalyticscore.h"
+
+/**
+ * Request body of a batch, read straight from the encoded messages.
+ * The body is never assembled in one buffer: the device keeps a shallow
+ * copy of every encoded message and only formats the queue time and the
+ * line break per message. The size is known up front and the device is
+ * random access, so the network stack can send it in chunks and rewind
+ * it on a retry.
+ */
+class GAnalyticsBatchBody : public QIODevice
+{
+public:
+    GAnalyticsBatchBody(const QList<GAnalyticsCore::Message> &messages, qint64 sendTime, QObject *parent = NULL);
+
+    bool isSequential() const;
+    qint64 size() const;
+
+protected:
+    qint64 readData(char *data, qint64 maxSize);
+    qint64 writeData(const char *data, qint64 maxSize);
+
+private:
+    int segmentAt(qint64 position) const;
+
+    QVector<QByteArray> segments;
+    QVector<qint64> offsets;            ///< Position of each segment in the body
+    qint64 total;
+};
+
+#endif // GANALYTICSBATCHBODY_H
@@ -0,0 +1,148 @@
+#include "ganalyticscompressor.h"
+
+#ifdef GANALYTICS_GZIP
+#include <zlib.h>
+
+// Window bits of deflate and inflate with a gzip header
+static const int gzipWindowBits = 15 + 16;
+static const int chunkSize = 4096;
+#endif // GANALYTICS_GZIP
+
+GAnalyticsCompressor::GAnalyticsCompressor()
+: stream(NULL)
+{
+}
+
+GAnalyticsCompressor::~GAnalyticsCompressor()
+{
+#ifdef GANALYTICS_GZIP
+    if (stream)
+    {
+        deflateEnd(stream);
+        delete stream;
+    }
+#endif // GANALYTICS_GZIP
+}
+
+bool GAnalyticsCompressor::isAvailable()
+{
+#ifdef GANALYTICS_GZIP
+    return true;
+#else
+    return false;
+#endif // GANALYTICS_GZIP
+}
+
+/**
+ * Gzip everything that can be read from a device.
+ * @param input         Read until its end.
+ * @param output        The compressed data.
+ * @return ok           False if compression is not available or failed.
+ */
+bool GAnalyticsCompressor::compress(QIODevice *input, QByteArray *output)
+{
+#ifdef GANALYTICS_GZIP
+    if (!stream)
+    {
+        stream = new z_stream;
+        stream->zalloc = Z_NULL;
+        stream->zfree = Z_NULL;
+        stream->opaque = Z_NULL;
+        if (deflateInit2(stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, gzipWindowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        {
+            delete stream;
+            stream = NULL;
+            return false;
+        }
+    }
+    else if (deflateReset(stream) != Z_OK)
+    {
+        return false;
+    }
+
+    output->clear();
+    output->reserve(int(qMax<qint64>(chunkSize, input->size() / 4)));
+
+    char chunk[chunkSize];
+    int status = Z_OK;
+    do
+    {
+        qint64 length = input->read(chunk, chunkSize);
+        if (length < 0 && !input->atEnd())
+        {
+            return false;
+        }
+        length = qMax<qint64>(length, 0);
+        int flush = length < chunkSize ? Z_FINISH : Z_NO_FLUSH;
+
+        stream->next_in = reinterpret_cast<Bytef*>(chunk);
+        stream->avail_in = uInt(length);
+        do
+        {
+            int offset = output->size();
+            output->resize(offset + chunkSize);
+            stream->next_out = reinterpret_cast<Bytef*>(output->data() + offset);
+            stream->avail_out = chunkSize;
+
+            status = deflate(stream, flush);
+            if (status == Z_STREAM_ERROR)
+            {
+                return false;
+            }
+            output->resize(offset + chunkSize - int(stream->avail_out));
+        }
+        while (stream->avail_out == 0);
+    }
+    while (status != Z_STREAM_END);
+
+    return true;
+#else
+    Q_UNUSED(input);
+    Q_UNUSED(output);
+
+    return false;
+#endif // GANALYTICS_GZIP
+}
+
+/**
+ * Unpack a gzip body, e.g. in a stand-in for the collector.
+ * @param input
+ * @param output
+ * @return ok           False if the data is not valid gzip or compression is not available.
+ */
+bool GAnalyticsCompressor::decompress(const QByteArray &input, QByteArray *output)
+{
+#ifdef GANALYTICS_GZIP
+    z_stream inflater;
+    inflater.zalloc = Z_NULL;
+    inflater.zfree = Z_NULL;
+    inflater.opaque = Z_NULL;
+    inflater.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.constData()));
+    inflater.avail_in = uInt(input.size());
+    if (inflateInit2(&inflater, gzipWindowBits) != Z_OK)
+    {
+        return false;
+    }
+
+    output->clear();
+    int status = Z_OK;
+    while (status == Z_OK)
+    {
+        int offset = output->size();
+        output->resize(offset + chunkSize);
+        inflater.next_out = reinterpret_cast<Bytef*>(output->data() + offset);
+        inflater.avail_out = chunkSize;
+
+        status = inflate(&inflater, Z_NO_FLUSH);
+        output->resize(offset + chunkSize - int(inflater.avail_out));
+    }
+    inflateEnd(&inflater);
+
+    return status == Z_STREAM_END;
+#else
+    Q_UNUSED(input);
+    Q_UNUSED(output);
+
+    return false;
+#endif // GANALYTICS_GZIP
+}
@@ -0,0 +1,33 @@
+#ifndef GANALYTICSCOMPRESSOR_H
+#define GANALYTICSCOMPRESSOR_H
+
+#include <QByteArray>
+#include <QIODevice>
+
+struct z_stream_s;
+
+/**
+ * Gzip encoder for request bodies. The deflate state is allocated once
+ * and reset for every body, so compressing a batch does not allocate
+ * the compression tables again. Only available if the library is built
+ * with CONFIG += ganalytics_gzip, which links zlib. Otherwise nothing
+ * is compressed.
+ */
+class GAnalyticsCompressor
+{
+public:
+    GAnalyticsCompressor();
+    ~GAnalyticsCompressor();
+
+    static bool isAvailable();
+
+    bool compress(QIODevice *input, QByteArray *output);
+    static bool decompress(const QByteArray &input, QByteArray *output);
+
+private:
+    Q_DISABLE_COPY(GAnalyticsCompressor)
+
+    z_stream_s *stream;
+};
+
+#endif // GANALYTICSCOMPRESSOR_H
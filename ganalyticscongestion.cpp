@@ -0,0 +1,169 @@
+#include "ganalyticscongestion.h"
+
+GAnalyticsCongestionControl::GAnalyticsCongestionControl()
+: lowerHits(1)
+, upperHits(20)
+, lowerPosts(1)
+, upperPosts(8)
+{
+    reset();
+}
+
+/**
+ * Limit the controller. The current values are clamped.
+ * @param minHits       Hits per request.
+ * @param maxHits
+ * @param minPosts      Requests in flight.
+ * @param maxPosts
+ */
+void GAnalyticsCongestionControl::setBounds(int minHits, int maxHits, int minPosts, int maxPosts)
+{
+    lowerHits = qMax(1, minHits);
+    upperHits = qMax(lowerHits, maxHits);
+    lowerPosts = qMax(1, minPosts);
+    upperPosts = qMax(lowerPosts, maxPosts);
+    clamp();
+}
+
+int GAnalyticsCongestionControl::minHits() const
+{
+    return lowerHits;
+}
+
+int GAnalyticsCongestionControl::maxHits() const
+{
+    return upperHits;
+}
+
+int GAnalyticsCongestionControl::minPosts() const
+{
+    return lowerPosts;
+}
+
+int GAnalyticsCongestionControl::maxPosts() const
+{
+    return upperPosts;
+}
+
+int GAnalyticsCongestionControl::hitsPerPost() const
+{
+    return int(hits);
+}
+
+int GAnalyticsCongestionControl::concurrentPosts() const
+{
+    return int(posts);
+}
+
+/**
+ * Smoothed round trip time, -1 before the first request.
+ */
+qint64 GAnalyticsCongestionControl::roundTripTime() const
+{
+    return smoothedRtt;
+}
+
+/**
+ * Delivered hits per second in the last measuring window.
+ */
+double GAnalyticsCongestionControl::throughput() const
+{
+    return rate;
+}
+
+/**
+ * A request was answered successfully.
+ * @param delivered     Number of hits it carried.
+ * @param full          True if the batch was limited by hitsPerPost(), not by the queue.
+ *                      Only full batches grow the window, an idle sender learns nothing.
+ * @param roundTrip     Time from posting to the reply.
+ * @param now
+ */
+void GAnalyticsCongestionControl::succeeded(int delivered, bool full, qint64 roundTrip, qint64 now)
+{
+    smoothedRtt = smoothedRtt < 0 ? roundTrip : (7 * smoothedRtt + roundTrip) / 8;
+    if (minRtt < 0 || roundTrip <= minRtt || ++minRttAge > minRttSamples)
+    {
+        minRtt = roundTrip;
+        minRttAge = 0;
+    }
+
+    // Measure over a few round trips
+    windowHits += delivered;
+    if (windowStart < 0)
+    {
+        windowStart = now;
+    }
+    else if (now - windowStart >= 4 * qMax<qint64>(smoothedRtt, 1))
+    {
+        rate = windowHits * 1000.0 / (now - windowStart);
+        bestRate = qMax(rate, bestRate * 0.95);
+        windowStart = now;
+        windowHits = 0;
+    }
+
+    if (roundTrip > 2 * minRtt + queueingSlack)
+    {
+        decrease(1.0, 0.75, now);
+    }
+    else if (!full)
+    {
+        return;
+    }
+    else if (rate < 0.8 * bestRate)
+    {
+        // More parallel requests did not deliver more
+        decrease(1.0, 0.9, now);
+    }
+    else
+    {
+        hits += 1.0;
+        posts += 1.0 / posts;
+        clamp();
+    }
+}
+
+/**
+ * A request failed with a network or server error.
+ * @param now
+ */
+void GAnalyticsCongestionControl::failed(qint64 now)
+{
+    decrease(0.5, 0.5, now);
+}
+
+/**
+ * Start over from the lower bounds.
+ */
+void GAnalyticsCongestionControl::reset()
+{
+    hits = lowerHits;
+    posts = lowerPosts;
+    smoothedRtt = -1;
+    minRtt = -1;
+    minRttAge = 0;
+    lastDecrease = -1;
+    windowStart = -1;
+    windowHits = 0;
+    rate = 0.0;
+    bestRate = 0.0;
+}
+
+void GAnalyticsCongestionControl::decrease(double hitFactor, double postFactor, qint64 now)
+{
+    if (lastDecrease >= 0 && now - lastDecrease < qMax<qint64>(smoothedRtt, 1))
+    {
+        return;
+    }
+
+    hits *= hitFactor;
+    posts *= postFactor;
+    lastDecrease = now;
+    clamp();
+}
+
+void GAnalyticsCongestionControl::clamp()
+{
+    hits = qBound<double>(lowerHits, hits, upperHits);
+    posts = qBound<double>(lowerPosts, posts, upperPosts);
+}
@@ -0,0 +1,62 @@
+#ifndef GANALYTICSCONGESTION_H
+#define GANALYTICSCONGESTION_H
+
+#include <QtGlobal>
+
+/**
+ * AIMD controller for the number of hits per request and of requests
+ * in flight. Every request which delivered a full batch in about the
+ * best round trip time seen so far grows the batch by one hit and the
+ * number of parallel requests by one per round. Errors halve both,
+ * a round trip time far above the best one (a queue building up on
+ * the link) or falling throughput shrink the number of parallel
+ * requests. Decreases happen at most once per round trip, so one bad
+ * round does not collapse the window. Times are milliseconds on any
+ * monotonic clock, like GAnalyticsThrottle.
+ */
+class GAnalyticsCongestionControl
+{
+public:
+    GAnalyticsCongestionControl();
+
+    void setBounds(int minHits, int maxHits, int minPosts, int maxPosts);
+    int minHits() const;
+    int maxHits() const;
+    int minPosts() const;
+    int maxPosts() const;
+
+    int hitsPerPost() const;
+    int concurrentPosts() const;
+    qint64 roundTripTime() const;
+    double throughput() const;
+
+    void succeeded(int delivered, bool full, qint64 roundTrip, qint64 now);
+    void failed(qint64 now);
+    void reset();
+
+private:
+    void decrease(double hitFactor, double postFactor, qint64 now);
+    void clamp();
+
+    const static int minRttSamples = 100;   ///< The best round trip is forgotten after so many samples
+    const static int queueingSlack = 25;    ///< Milliseconds of round trip variation which are no queue
+
+    int lowerHits;
+    int upperHits;
+    int lowerPosts;
+    int upperPosts;
+
+    double hits;
+    double posts;
+    qint64 smoothedRtt;
+    qint64 minRtt;
+    int minRttAge;
+    qint64 lastDecrease;
+
+    qint64 windowStart;
+    int windowHits;
+    double rate;                ///< Delivered hits per second in the last measuring window
+    double bestRate;
+};
+
+#endif // GANALYTICSCONGESTION_H
@@ -0,0 +1,1346 @@
+#include "ganalyticscore.h"
+#include "ganalyticsbatchbody.h"
+#include "ganalyticstrace.h"
+
+#include <QBuffer>
+#include <QDateTime>
+#include <QDebug>
+#include <QThread>
+
+const QString GAnalyticsCore::dateTimeFormat  = "yyyy,MM,dd-hh:mm::ss:zzz";
+const QString GAnalyticsCore::anchorPrefix = "GAnalytics-anchor=";
+
+static const QUrl defaultEndpoint("http://www.google-analytics.com/");
+
+GAnalyticsCore::Queue::Queue()
+: bulkSkips(0)
+{
+}
+
+void GAnalyticsCore::Queue::enqueue(const Message &message)
+{
+    lanes[message.priority].enqueue(message);
+}
+
+/**
+ * Put a message back to the head of its lane.
+ * @param message
+ */
+void GAnalyticsCore::Queue::requeue(const Message &message)
+{
+    lanes[message.priority].prepend(message);
+}
+
+/**
+ * Take the next message to send. The queue must not be empty.
+ * @return message
+ */
+GAnalyticsCore::Message GAnalyticsCore::Queue::dequeue()
+{
+    if (!lanes[Urgent].isEmpty())
+    {
+        return dequeue(Urgent);
+    }
+
+    if (lanes[Normal].isEmpty() || (bulkSkips >= maxBulkSkips && !lanes[Bulk].isEmpty()))
+    {
+        return dequeue(Bulk);
+    }
+
+    return dequeue(Normal);
+}
+
+/**
+ * Take the head of a lane. The lane must not be empty.
+ * @param priority
+ * @return message
+ */
+GAnalyticsCore::Message GAnalyticsCore::Queue::dequeue(Priority priority)
+{
+    if (priority == Bulk)
+    {
+        bulkSkips = 0;
+    }
+    else if (priority == Normal && !lanes[Bulk].isEmpty())
+    {
+        ++bulkSkips;
+    }
+
+    return lanes[priority].dequeue();
+}
+
+/**
+ * Drop all messages older than maxAge.
+ * @param now           Current time on the monotonic clock.
+ * @param maxAge        Maximum age in milliseconds.
+ * @return count        Number of dropped messages.
+ */
+int GAnalyticsCore::Queue::removeExpired(qint64 now, qint64 maxAge)
+{
+    int removed = 0;
+    for (int lane = 0; lane < laneCount; ++lane)
+    {
+        QQueue<Message> kept;
+        foreach (const Message &message, lanes[lane])
+        {
+            if (now - message.time > maxAge)
+            {
+                ++removed;
+            }
+            else
+            {
+                kept.enqueue(message);
+            }
+        }
+        lanes[lane] = kept;
+    }
+
+    return removed;
+}
+
+/**
+ * Remove all messages of a lane.
+ * @param priority
+ * @return list         The messages of the lane.
+ */
+QList<GAnalyticsCore::Message> GAnalyticsCore::Queue::take(Priority priority)
+{
+    QList<Message> list = lanes[priority];
+    lanes[priority].clear();
+
+    return list;
+}
+
+/**
+ * All messages, most important lane first.
+ * @return list
+ */
+QList<GAnalyticsCore::Message> GAnalyticsCore::Queue::toList() const
+{
+    QList<Message> list;
+    for (int lane = 0; lane < laneCount; ++lane)
+    {
+        list << lanes[lane];
+    }
+
+    return list;
+}
+
+void GAnalyticsCore::Queue::clear()
+{
+    for (int lane = 0; lane < laneCount; ++lane)
+    {
+        lanes[lane].clear();
+    }
+    bulkSkips = 0;
+}
+
+bool GAnalyticsCore::Queue::isEmpty() const
+{
+    return count() == 0;
+}
+
+int GAnalyticsCore::Queue::count() const
+{
+    int total = 0;
+    for (int lane = 0; lane < laneCount; ++lane)
+    {
+        total += lanes[lane].count();
+    }
+
+    return total;
+}
+
+int GAnalyticsCore::Queue::count(Priority priority) const
+{
+    return lanes[priority].count();
+}
+
+/**
+ * Constructor
+ * All messages are stamped relative to the time of construction.
+ */
+GAnalyticsCore::GAnalyticsCore()
+: level(Error)
+, virtualClock(NULL)
+, maxAge(fourHours)
+, adaptive(false)
+, compressionMinimum(0)
+, bytesBeforeCompression(0)
+, bytesAfterCompression(0)
+, compressPages(true)
+, bytesPersisted(0)
+, messagesPersisted(0)
+, sent(0)
+, rejected(0)
+{
+    clock.start();
+    anchor = QDateTime::currentMSecsSinceEpoch();
+    setEndpoint(defaultEndpoint);
+}
+
+void GAnalyticsCore::setTrackingID(const QString &trackingID)
+{
+    tid = trackingID;
+    standardFieldCache.clear();
+}
+
+QString GAnalyticsCore::trackingID() const
+{
+    return tid;
+}
+
+void GAnalyticsCore::setClientID(const QString &clientID)
+{
+    cid = clientID;
+    standardFieldCache.clear();
+}
+
+QString GAnalyticsCore::clientID() const
+{
+    return cid;
+}
+
+void GAnalyticsCore::setUserID(const QString &userID)
+{
+    uid = userID;
+    standardFieldCache.clear();
+}
+
+QString GAnalyticsCore::userID() const
+{
+    return uid;
+}
+
+void GAnalyticsCore::setAppName(const QString &appName)
+{
+    an = appName;
+    screenViewCache.clear();
+}
+
+QString GAnalyticsCore::appName() const
+{
+    return an;
+}
+
+void GAnalyticsCore::setAppVersion(const QString &appVersion)
+{
+    av = appVersion;
+    screenViewCache.clear();
+}
+
+QString GAnalyticsCore::appVersion() const
+{
+    return av;
+}
+
+void GAnalyticsCore::setLanguage(const QString &language)
+{
+    ul = language;
+    standardFieldCache.clear();
+}
+
+QString GAnalyticsCore::language() const
+{
+    return ul;
+}
+
+void GAnalyticsCore::setScreenResolution(const QString &screenResolution)
+{
+    sr = screenResolution;
+    standardFieldCache.clear();
+}
+
+QString GAnalyticsCore::screenResolution() const
+{
+    return sr;
+}
+
+void GAnalyticsCore::setViewportSize(const QString &viewportSize)
+{
+    vp = viewportSize;
+    standardFieldCache.clear();
+}
+
+QString GAnalyticsCore::viewportSize() const
+{
+    return vp;
+}
+
+void GAnalyticsCore::setUserAgent(const QString &userAgent)
+{
+    ua = userAgent;
+}
+
+QString GAnalyticsCore::userAgent() const
+{
+    return ua;
+}
+
+void GAnalyticsCore::setLogLevel(LogLevel logLevel)
+{
+    level = logLevel;
+}
+
+GAnalyticsCore::LogLevel GAnalyticsCore::logLevel() const
+{
+    return level;
+}
+
+void GAnalyticsCore::logMessage(LogLevel level, const QString &message) const
+{
+    if (this->level > level)
+    {
+        return;
+    }
+
+    qDebug() << "[Analytics]" << message;
+}
+
+/**
+ * Replace the monotonic clock, e.g. by a virtual one.
+ * @param clock         NULL to use the process clock. Ownership is not taken.
+ */
+void GAnalyticsCore::setClock(const GAnalyticsClock *clock)
+{
+    virtualClock = clock;
+}
+
+qint64 GAnalyticsCore::now() const
+{
+    return virtualClock ? virtualClock->elapsed() : clock.elapsed();
+}
+
+/**
+ * Wall clock time (UTC) of the start of the monotonic clock.
+ */
+qint64 GAnalyticsCore::clockAnchor() const
+{
+    return anchor;
+}
+
+void GAnalyticsCore::setMaxMessageAge(qint64 milliseconds)
+{
+    maxAge = milliseconds;
+}
+
+qint64 GAnalyticsCore::maxMessageAge() const
+{
+    return maxAge;
+}
+
+void GAnalyticsCore::setRateLimit(int burst, double messagesPerSecond)
+{
+    throttle.setRate(burst, messagesPerSecond);
+}
+
+int GAnalyticsCore::rateLimitBurst() const
+{
+    return throttle.burst();
+}
+
+double GAnalyticsCore::rateLimitPerSecond() const
+{
+    return throttle.tokensPerSecond();
+}
+
+/**
+ * Send to another host, e.g. a relay of the application.
+ * Messages are posted to its collect and batch paths.
+ * @param endpoint      Base url, e.g. "https://relay.example.com/analytics/".
+ */
+void GAnalyticsCore::setEndpoint(const QUrl &endpoint)
+{
+    QUrl base = endpoint;
+    if (!base.path().endsWith('/'))
+    {
+        base.setPath(base.path() + '/');
+    }
+
+    collectUrl = base.resolved(QUrl("collect"));
+    batchUrl = base.resolved(QUrl("batch"));
+}
+
+QUrl GAnalyticsCore::endpoint() const
+{
+    return collectUrl.resolved(QUrl("."));
+}
+
+/**
+ * Gzip request bodies of at least the given size. The collector of
+ * Google Analytics does not accept compressed bodies, so only enable
+ * this for an endpoint which does. Needs a build with gzip support.
+ * @param bytes         0 disables compression.
+ */
+void GAnalyticsCore::setCompressionThreshold(int bytes)
+{
+    if (bytes > 0 && !GAnalyticsCompressor::isAvailable())
+    {
+        logMessage(Error, "Compression is not available, build with CONFIG += ganalytics_gzip");
+    }
+    compressionMinimum = qMax(0, bytes);
+}
+
+int GAnalyticsCore::compressionThreshold() const
+{
+    return compressionMinimum;
+}
+
+/**
+ * Let the number of hits per request and of parallel requests follow
+ * the measured round trip times, errors and throughput, within the
+ * dispatch bounds. Otherwise single hits are sent one at a time and
+ * catching up uses full batches with a fixed number of requests.
+ * @param enabled
+ */
+void GAnalyticsCore::setAdaptiveDispatch(bool enabled)
+{
+    if (adaptive != enabled)
+    {
+        adaptive = enabled;
+        congestion.reset();
+    }
+}
+
+bool GAnalyticsCore::adaptiveDispatch() const
+{
+    return adaptive;
+}
+
+/**
+ * Bounds of the adaptive dispatch.
+ * @param minHits       Hits per request, at most maxHitsPerBatch.
+ * @param maxHits
+ * @param minPosts      Requests in flight.
+ * @param maxPosts
+ */
+void GAnalyticsCore::setDispatchBounds(int minHits, int maxHits, int minPosts, int maxPosts)
+{
+    // A copy, qMin() takes references and the constant has no definition
+    const int upperLimit = maxHitsPerBatch;
+    congestion.setBounds(qMin(minHits, upperLimit), qMin(maxHits, upperLimit), minPosts, maxPosts);
+}
+
+const GAnalyticsCongestionControl &GAnalyticsCore::congestionControl() const
+{
+    return congestion;
+}
+
+/**
+ * Number of hits to take into the next batch.
+ */
+int GAnalyticsCore::hitsPerPost() const
+{
+    return adaptive ? congestion.hitsPerPost() : maxHitsPerBatch;
+}
+
+/**
+ * Build the POST query. Adds all parameter to the query
+ * which are used in every POST.
+ * @param type      Type of POST message. The event which is to post.
+ * @return query    Most used parameter in a query for a POST.
+ */
+QUrlQuery GAnalyticsCore::buildStandardPostQuery(const QString &type) const
+{
+    GANALYTICS_TRACE_SPAN("buildStandardPostQuery");
+
+    QUrlQuery query;
+    query.addQueryItem("v", "1");
+    query.addQueryItem("tid", tid);
+    query.addQueryItem("cid", cid);
+    if(!uid.isEmpty())
+    {
+        query.addQueryItem("uid", uid);
+    }
+    query.addQueryItem("t", type);
+    query.addQueryItem("ul", ul);
+
+#ifdef QT_GUI_LIB
+    query.addQueryItem("vp", vp);
+    query.addQueryItem("sr", sr);
+#endif // QT_GUI_LIB
+
+    return query;
+}
+
+/**
+ * Build the query of a screen view.
+ * @param screenName
+ * @return query
+ */
+QUrlQuery GAnalyticsCore::buildScreenViewQuery(const QString &screenName) const
+{
+    QUrlQuery query = buildStandardPostQuery("screenview");
+    query.addQueryItem("cd", screenName);
+    query.addQueryItem("an", an);
+    query.addQueryItem("av", av);
+
+    return query;
+}
+
+/**
+ * Build the query of an event.
+ * @param category
+ * @param action
+ * @param label         Optional.
+ * @param value         Optional.
+ * @return query
+ */
+QUrlQuery GAnalyticsCore::buildEventQuery(const QString &category, const QString &action,
+                                          const QString &label, const QVariant &value) const
+{
+    QUrlQuery query = buildStandardPostQuery("event");
+    query.addQueryItem("an", an);
+    query.addQueryItem("av", av);
+    query.addQueryItem("ec", category);
+    query.addQueryItem("ea", action);
+    if (! label.isEmpty())
+        query.addQueryItem("el", label);
+    if (value.isValid())
+        query.addQueryItem("ev", value.toString());
+
+    return query;
+}
+
+/**
+ * Build the query of an exception.
+ * @param exceptionDescription
+ * @param exceptionFatal
+ * @return query
+ */
+QUrlQuery GAnalyticsCore::buildExceptionQuery(const QString &exceptionDescription, bool exceptionFatal) const
+{
+    QUrlQuery query = buildStandardPostQuery("exception");
+    query.addQueryItem("an", an);
+    query.addQueryItem("av", av);
+    query.addQueryItem("exd", exceptionDescription);
+    query.addQueryItem("exf", exceptionFatal ? "1" : "0");
+
+    return query;
+}
+
+/**
+ * Build the query of a timing message.
+ * @param category
+ * @param variable
+ * @param milliseconds
+ * @param label         Optional.
+ * @return query
+ */
+QUrlQuery GAnalyticsCore::buildTimingQuery(const QString &category, const QString &variable,
+                                           int milliseconds, const QString &label) const
+{
+    QUrlQuery query = buildStandardPostQuery("timing");
+    query.addQueryItem("an", an);
+    query.addQueryItem("av", av);
+    query.addQueryItem("utc", category);
+    query.addQueryItem("utv", variable);
+    query.addQueryItem("utt", QString::number(milliseconds));
+    if (! label.isEmpty())
+        query.addQueryItem("utl", label);
+
+    return query;
+}
+
+void GAnalyticsCore::appendCustomValues(QUrlQuery &query, const QVariantMap &customValues)
+{
+    for (QVariantMap::const_iterator iter = customValues.begin(); iter != customValues.end(); ++iter)
+    {
+        query.addQueryItem(iter.key(), iter.value().toString());
+    }
+}
+
+/**
+ * The queue time parameter appended to a message when it is sent.
+ * @param message
+ * @param sendTime
+ * @return field        "&qt=" and the milliseconds since the message was queued.
+ */
+QByteArray GAnalyticsCore::queueTimeField(const Message &message, qint64 sendTime)
+{
+    return "&qt=" + QByteArray::number(qMax<qint64>(0, sendTime - message.time));
+}
+
+/**
+ * Encode a screen view without custom values. The fields after the
+ * standard ones are encoded once per screen name, so the names of the
+ * screens an application navigates between are only encoded the first
+ * time they are shown.
+ * @param screenName
+ * @return query        Encoded, like buildScreenViewQuery().
+ */
+QByteArray GAnalyticsCore::encodeScreenView(const QString &screenName) const
+{
+    GANALYTICS_TRACE_SPAN("encodeScreenView");
+
+    QHash<QString, QByteArray>::const_iterator iter = screenViewCache.constFind(screenName);
+    if (iter == screenViewCache.constEnd())
+    {
+        if (screenViewCache.count() >= maxCachedScreenViews)
+        {
+            screenViewCache.clear();
+        }
+
+        QUrlQuery query;
+        query.addQueryItem("cd", screenName);
+        query.addQueryItem("an", an);
+        query.addQueryItem("av", av);
+        iter = screenViewCache.insert(screenName, query.query(QUrl::FullyEncoded).toUtf8());
+    }
+
+    const QByteArray &fields = standardFields("screenview");
+
+    QByteArray encoded;
+    encoded.reserve(fields.size() + 1 + iter.value().size());
+    encoded += fields;
+    encoded += '&';
+    encoded += iter.value();
+
+    return encoded;
+}
+
+/**
+ * The fields every message of a hit type starts with, encoded
+ * like buildStandardPostQuery() once per type and again after
+ * one of them changed.
+ * @param type          Hit type, e.g. "event".
+ */
+const QByteArray &GAnalyticsCore::standardFields(const QString &type) const
+{
+    QHash<QString, QByteArray>::const_iterator iter = standardFieldCache.constFind(type);
+    if (iter == standardFieldCache.constEnd())
+    {
+        iter = standardFieldCache.insert(type, buildStandardPostQuery(type).query(QUrl::FullyEncoded).toUtf8());
+    }
+
+    return iter.value();
+}
+
+/**
+ * Register an event which is sent many times with the same category,
+ * action and custom values. These are encoded once, sending by handle
+ * only encodes the label, the value and the varying values.
+ * The app name and version are taken at registration.
+ * @param category
+ * @param action
+ * @param customValues  Fixed custom dimensions and metrics.
+ * @return handle       For buildFromEventTemplate().
+ */
+int GAnalyticsCore::registerEventTemplate(const QString &category, const QString &action,
+                                          const QVariantMap &customValues)
+{
+    QUrlQuery query;
+    query.addQueryItem("an", an);
+    query.addQueryItem("av", av);
+    query.addQueryItem("ec", category);
+    query.addQueryItem("ea", action);
+    appendCustomValues(query, customValues);
+
+    templates << query.query(QUrl::FullyEncoded).toUtf8();
+    return templates.count() - 1;
+}
+
+/**
+ * Build an event from a registered template.
+ * @param handle        Returned by registerEventTemplate().
+ * @param label         Optional.
+ * @param value         Optional.
+ * @param varyingValues Custom values which differ per event.
+ * @return query        Encoded, empty if the handle is unknown.
+ */
+QByteArray GAnalyticsCore::buildFromEventTemplate(int handle, const QString &label, const QVariant &value,
+                                                  const QVariantMap &varyingValues) const
+{
+    GANALYTICS_TRACE_SPAN("buildFromEventTemplate");
+
+    if (handle < 0 || handle >= templates.count())
+    {
+        logMessage(Error, QString("Unknown hit template %1").arg(handle));
+        return QByteArray();
+    }
+
+    const QByteArray &fields = standardFields("event");
+    const QByteArray &fixed = templates.at(handle);
+
+    QByteArray query;
+    query.reserve(fields.size() + fixed.size() + 64);
+    query += fields;
+    query += '&';
+    query += fixed;
+    if (!label.isEmpty())
+    {
+        query += "&el=";
+        query += QUrl::toPercentEncoding(label);
+    }
+    if (value.isValid())
+    {
+        query += "&ev=";
+        query += QUrl::toPercentEncoding(value.toString());
+    }
+    for (QVariantMap::const_iterator iter = varyingValues.begin(); iter != varyingValues.end(); ++iter)
+    {
+        query += '&';
+        query += QUrl::toPercentEncoding(iter.key());
+        query += '=';
+        query += QUrl::toPercentEncoding(iter.value().toString());
+    }
+
+    return query;
+}
+
+/**
+ * Bring a persisted query into the encoded form. Older
+ * versions persisted the decoded form.
+ * @param query
+ * @return encodedQuery
+ */
+QByteArray GAnalyticsCore::normalized(const QString &query)
+{
+    return QUrlQuery(query).query(QUrl::FullyEncoded).toUtf8();
+}
+
+/**
+ * Find the value of a parameter in an encoded query.
+ * @param encodedQuery
+ * @param key
+ * @return value        Still encoded, empty if the key is missing.
+ */
+QByteArray GAnalyticsCore::queryItemValue(const QByteArray &encodedQuery, const QByteArray &key)
+{
+    int start = 0;
+    while (start < encodedQuery.size())
+    {
+        int end = encodedQuery.indexOf('&', start);
+        if (end < 0)
+        {
+            end = encodedQuery.size();
+        }
+
+        if (end - start > key.size() && encodedQuery.at(start + key.size()) == '='
+            && qstrncmp(encodedQuery.constData() + start, key.constData(), uint(key.size())) == 0)
+        {
+            return encodedQuery.mid(start + key.size() + 1, end - start - key.size() - 1);
+        }
+
+        start = end + 1;
+    }
+
+    return QByteArray();
+}
+
+/**
+ * Stamp a message with the current time and queue it.
+ * @param query
+ * @param priority
+ */
+void GAnalyticsCore::enqueue(const QUrlQuery &query, Priority priority)
+{
+    enqueue(query.query(QUrl::FullyEncoded).toUtf8(), priority);
+}
+
+/**
+ * Stamp an encoded message with the current time and queue it.
+ * @param encodedQuery
+ * @param priority
+ */
+void GAnalyticsCore::enqueue(const QByteArray &encodedQuery, Priority priority)
+{
+    GANALYTICS_TRACE_SPAN("enqueue");
+
+    Message message;
+    message.query = encodedQuery;
+    message.time = now();
+    message.priority = priority;
+    message.sendAlone = false;
+
+    queue.enqueue(message);
+}
+
+/**
+ * Put messages back to the head of their lanes in their original order.
+ * @param messages
+ */
+void GAnalyticsCore::requeue(const QList<Message> &messages)
+{
+    for (int i = messages.count() - 1; i >= 0; --i)
+    {
+        queue.requeue(messages.at(i));
+    }
+}
+
+QList<GAnalyticsCore::Message> GAnalyticsCore::take(Priority priority)
+{
+    return queue.take(priority);
+}
+
+/**
+ * The queued messages, most important lane first.
+ * Messages in the backlog are not included.
+ */
+QList<GAnalyticsCore::Message> GAnalyticsCore::messages() const
+{
+    return queue.toList();
+}
+
+/**
+ * Drop queued messages older than the maximum message age.
+ * @return count        Number of dropped messages.
+ */
+int GAnalyticsCore::removeExpired()
+{
+    return queue.removeExpired(now(), maxAge);
+}
+
+/**
+ * Drop all queued messages, including the backlog.
+ */
+void GAnalyticsCore::clear()
+{
+    queue.clear();
+    backlog.clear();
+}
+
+bool GAnalyticsCore::isEmpty() const
+{
+    return queue.isEmpty() && backlog.isEmpty();
+}
+
+int GAnalyticsCore::count() const
+{
+    return queue.count();
+}
+
+int GAnalyticsCore::count(Priority priority) const
+{
+    return queue.count(priority);
+}
+
+int GAnalyticsCore::backlogCount() const
+{
+    return backlog.count();
+}
+
+/**
+ * Convert messages into the persisted format.
+ * The list starts with the wall clock time (UTC) the time
+ * stamps are relative to, followed by a query and a time
+ * stamp per message.
+ * @param messages
+ * @return dataList
+ */
+QList<QString> GAnalyticsCore::persistMessages(const QList<Message> &messages) const
+{
+    GANALYTICS_TRACE_SPAN("persistMessages");
+
+    QList<QString> dataList;
+    dataList << anchorPrefix + QString::number(anchor);
+    foreach (const Message &message, messages)
+    {
+        dataList << QString::fromLatin1(message.query);
+        dataList << QString::number(message.time);
+    }
+
+    return dataList;
+}
+
+/**
+ * Queue persisted messages into the bulk lane.
+ * Two lines in the list build a message. An anchor
+ * line sets the wall clock time the following time stamps are
+ * relative to. Without an anchor, time stamps are local date
+ * times as written by older versions.
+ * @param dataList
+ */
+void GAnalyticsCore::readMessages(const QList<QString> &dataList)
+{
+    GANALYTICS_TRACE_SPAN("readMessages");
+
+    bool hasAnchor = false;
+    qint64 dataAnchor = 0;
+
+    QListIterator<QString> iter(dataList);
+    while (iter.hasNext())
+    {
+        QString queryString = iter.next();
+        if (queryString.startsWith(anchorPrefix))
+        {
+            dataAnchor = queryString.mid(anchorPrefix.length()).toLongLong(&hasAnchor);
+            continue;
+        }
+        if(!iter.hasNext())
+            break;
+        QString dateString = iter.next();
+        if(queryString.isEmpty() || dateString.isEmpty())
+            break;
+        qint64 wallTime;
+        if (hasAnchor)
+        {
+            wallTime = dataAnchor + dateString.toLongLong();
+        }
+        else
+        {
+            wallTime = QDateTime::fromString(dateString, dateTimeFormat).toMSecsSinceEpoch();
+        }
+        Message message;
+        message.query = normalized(queryString);
+        message.time = wallTime - anchor;
+        message.priority = Bulk;
+        message.sendAlone = false;
+        queue.enqueue(message);
+    }
+}
+
+/**
+ * Write the queue followed by the backlog which is not loaded
+ * yet as pages. Backlog pages are copied without decoding.
+ * @param outStream
+ */
+void GAnalyticsCore::writeMessages(QDataStream &outStream)
+{
+    GANALYTICS_TRACE_SPAN("writeMessages");
+
+    outStream << GAnalyticsBacklog::magic << GAnalyticsBacklog::version;
+    qint64 written = 8;
+
+    GAnalyticsBacklog::Encoding encoding = compressPages ? GAnalyticsBacklog::Compressed : GAnalyticsBacklog::Plain;
+    QList<GAnalyticsBacklog::Record> records;
+    foreach (const Message &message, queue.toList())
+    {
+        GAnalyticsBacklog::Record record;
+        record.time = anchor + message.time;
+        record.message = QString::fromLatin1(message.query);
+        records << record;
+
+        if (records.count() == messagesPerPage)
+        {
+            written += GAnalyticsBacklog::writePage(outStream, records, encoding);
+            records.clear();
+        }
+    }
+    written += GAnalyticsBacklog::writePage(outStream, records, encoding);
+
+    written += backlog.writePages(outStream);
+    outStream << quint32(0);
+
+    bytesPersisted += written + 4;
+    messagesPersisted += queue.count() + backlog.count();
+}
+
+/**
+ * Compress the pages written by writeMessages(). Pages read from
+ * a stream are written back in the encoding they were read in.
+ * @param enabled       On by default.
+ */
+void GAnalyticsCore::setCompressPersistedMessages(bool enabled)
+{
+    compressPages = enabled;
+}
+
+bool GAnalyticsCore::compressPersistedMessages() const
+{
+    return compressPages;
+}
+
+/**
+ * Bytes written by writeMessages() so far.
+ */
+qint64 GAnalyticsCore::persistedBytes() const
+{
+    return bytesPersisted;
+}
+
+/**
+ * Messages written by writeMessages() so far.
+ */
+qint64 GAnalyticsCore::persistedMessageCount() const
+{
+    return messagesPersisted;
+}
+
+/**
+ * Read persisted messages. Pages are moved into the backlog
+ * and loaded on demand, only the first page is loaded right
+ * away. Streams written by older versions hold a QList<QString>
+ * and are loaded completely.
+ * @param inStream
+ */
+void GAnalyticsCore::readMessages(QDataStream &inStream)
+{
+    GANALYTICS_TRACE_SPAN("readMessages");
+
+    quint32 magic;
+    inStream >> magic;
+
+    if (magic != GAnalyticsBacklog::magic)
+    {
+        // The number of entries of an old QList<QString>.
+        QList<QString> dataList;
+        for (quint32 i = 0; i < magic && inStream.status() == QDataStream::Ok; ++i)
+        {
+            QString entry;
+            inStream >> entry;
+            dataList << entry;
+        }
+        readMessages(dataList);
+        return;
+    }
+
+    quint32 version;
+    inStream >> version;
+    if (version > GAnalyticsBacklog::version)
+    {
+        logMessage(Error, QString("Unknown format version %1 of persisted messages").arg(version));
+        return;
+    }
+
+    int unreadable = 0;
+    int count = backlog.readPages(inStream, version, anchor + now() - maxAge, &unreadable);
+    logMessage(Debug, QString("%1 persisted message(s) in the backlog").arg(count));
+    if (unreadable > 0)
+    {
+        logMessage(Error, QString("%1 persisted message(s) dropped, unknown page encoding").arg(unreadable));
+    }
+
+    refillFromBacklog();
+}
+
+/**
+ * Load backlog pages into the bulk lane while it runs low,
+ * so only a bounded number of messages is kept in memory.
+ */
+void GAnalyticsCore::refillFromBacklog()
+{
+    GANALYTICS_TRACE_SPAN("refillFromBacklog");
+
+    while (!backlog.isEmpty() && queue.count(Bulk) < messagesPerPage)
+    {
+        foreach (const GAnalyticsBacklog::Record &record, backlog.takePage(anchor + now() - maxAge))
+        {
+            Message message;
+            message.query = normalized(record.message);
+            message.time = record.time - anchor;
+            message.priority = Bulk;
+            message.sendAlone = false;
+            queue.enqueue(message);
+        }
+    }
+}
+
+/**
+ * Take up to maxHits messages from the queue to be posted in one request.
+ * A single message goes to the collect endpoint, several messages go to
+ * the batch endpoint. Messages which are too old are dropped,
+ * messages which are too large are moved to the dead letters.
+ * Every message takes a token of the throttle. Messages of a tracking
+ * id without tokens are skipped, so they do not hold up the messages
+ * of other tracking ids, and stay in order at the head of their lanes.
+ * throttleWait is then set to the earliest time one of them may be
+ * sent. Urgent messages never wait, their tokens are paid back by the
+ * following messages.
+ * The caller hands the batch to finishBatch() once the post has ended.
+ * @param maxHits
+ * @param urgentOnly    Take messages from the urgent lane only.
+ * @return batch        Empty if there was nothing to send.
+ */
+GAnalyticsCore::Batch GAnalyticsCore::takeBatch(int maxHits, bool urgentOnly)
+{
+    GANALYTICS_TRACE_SPAN("takeBatch");
+
+    refillFromBacklog();
+
+    qint64 sendTime = now();
+    Batch batch;
+    batch.sendTime = sendTime;
+    batch.size = 0;
+    batch.full = false;
+    batch.throttleWait = 0;
+
+    QList<Message> throttled;
+    QHash<QString, qint64> throttledIDs;   // Tracking ids without tokens and their wait time
+
+    while (batch.messages.count() < maxHits && throttled.count() < maxThrottledSkips)
+    {
+        if (urgentOnly ? queue.count(Urgent) == 0 : queue.isEmpty())
+        {
+            break;
+        }
+
+        Message message = urgentOnly ? queue.dequeue(Urgent) : queue.dequeue();
+        if (sendTime - message.time > maxAge)
+        {
+            // too old.
+            continue;
+        }
+
+        if (message.sendAlone && !batch.messages.isEmpty())
+        {
+            queue.requeue(message);
+            break;
+        }
+
+        int hitSize = message.query.size() + queueTimeField(message, sendTime).size();
+        if (hitSize > maxBytesPerHit)
+        {
+            addDeadLetter(message, 0, QString("Message exceeds %1 bytes").arg(maxBytesPerHit));
+            continue;
+        }
+
+        if (!batch.messages.isEmpty() && batch.size + 1 + hitSize > maxBytesPerBatch)
+        {
+            queue.requeue(message);
+            batch.full = true;
+            break;
+        }
+
+        if (throttle.isEnabled())
+        {
+            QString trackingID = QString::fromLatin1(queryItemValue(message.query, "tid"));
+            if (urgentOnly)
+            {
+                throttle.take(trackingID, sendTime);
+            }
+            else if (throttledIDs.contains(trackingID) || !throttle.tryTake(trackingID, sendTime))
+            {
+                if (!throttledIDs.contains(trackingID))
+                {
+                    throttledIDs.insert(trackingID, throttle.waitTime(trackingID, sendTime));
+                }
+                throttled << message;
+                continue;
+            }
+        }
+
+        if (!batch.messages.isEmpty())
+        {
+            ++batch.size;
+        }
+        batch.size += hitSize;
+        batch.messages << message;
+
+        if (message.sendAlone)
+        {
+            break;
+        }
+    }
+
+    // Ahead of everything left in the queue, as before
+    requeue(throttled);
+    foreach (qint64 wait, throttledIDs)
+    {
+        qint64 due = wait > 0 ? wait : -1;
+        batch.throttleWait = batch.throttleWait == 0 ? due : qMin(batch.throttleWait, due);
+    }
+
+    batch.full = batch.full || batch.messages.count() >= maxHits;
+    batch.url = batch.messages.count() > 1 ? batchUrl : collectUrl;
+
+    return batch;
+}
+
+/**
+ * Compress the body of a batch if it reaches the compression
+ * threshold. The device is read to its end in that case.
+ * @param batch
+ * @param body          The body of the batch.
+ * @param compressed    The gzip encoded body.
+ * @return encoded      True if the compressed body is to be sent.
+ */
+bool GAnalyticsCore::compressBody(const Batch &batch, QIODevice *body, QByteArray *compressed)
+{
+    GANALYTICS_TRACE_SPAN("compressBody");
+
+    if (compressionMinimum <= 0 || batch.size < compressionMinimum || !GAnalyticsCompressor::isAvailable())
+    {
+        return false;
+    }
+
+    if (!compressor.compress(body, compressed))
+    {
+        logMessage(Error, "Compressing the request body failed, sending it uncompressed");
+        body->seek(0);
+        return false;
+    }
+
+    bytesBeforeCompression += batch.size;
+    bytesAfterCompression += compressed->size();
+
+    return true;
+}
+
+/**
+ * Evaluate a finished post. Sent messages are counted. After a
+ * network or server error the messages go back to the queue.
+ * A message the collector refused is moved to the dead letters,
+ * so it does not block the messages behind it. The messages of
+ * a refused batch are sent again one by one. With adaptive
+ * dispatch, the outcome and round trip time drive the controller.
+ * @param batch         As returned by takeBatch().
+ * @param httpStatus    Status of the reply, 0 if the collector was not reached.
+ * @param errorString
+ * @return result       How the post ended.
+ */
+GAnalyticsCore::PostResult GAnalyticsCore::finishBatch(const Batch &batch, int httpStatus,
+                                                       const QString &errorString)
+{
+    GANALYTICS_TRACE_SPAN("finishBatch");
+
+    const QList<Message> &messages = batch.messages;
+    qint64 finished = now();
+
+    if (httpStatus >= 200 && httpStatus <= 299)
+    {
+        logMessage(Debug, QString("%1 message(s) sent").arg(messages.count()));
+        sent += messages.count();
+        if (adaptive)
+        {
+            congestion.succeeded(messages.count(), batch.full, finished - batch.sendTime, finished);
+        }
+        return PostSucceeded;
+    }
+
+    if (httpStatus == 0 || httpStatus >= 500 || httpStatus == 408 || httpStatus == 429)
+    {
+        logMessage(Error, QString("Error posting message: %1").arg(errorString));
+        requeue(messages);
+        if (adaptive)
+        {
+            congestion.failed(finished);
+        }
+        return PostRetryable;
+    }
+
+    if (messages.count() > 1)
+    {
+        logMessage(Error, QString("Batch rejected with status %1, retrying messages one by one").arg(httpStatus));
+        QList<Message> single = messages;
+        for (int i = 0; i < single.count(); ++i)
+        {
+            single[i].sendAlone = true;
+        }
+        requeue(single);
+    }
+    else
+    {
+        foreach (const Message &message, messages)
+        {
+            addDeadLetter(message, httpStatus, errorString);
+        }
+    }
+
+    return PostRejected;
+}
+
+/**
+ * Post the queue in batches through a blocking transport until it
+ * is empty, the deadline expires or a post fails. Waits for the
+ * throttle if the wait fits into the deadline.
+ * This is the driver for code without an event loop.
+ * @param transport
+ * @param deadline      Time budget in milliseconds.
+ * @return sent         Number of sent messages.
+ */
+int GAnalyticsCore::send(GAnalyticsTransport *transport, int deadline)
+{
+    QElapsedTimer elapsed;
+    elapsed.start();
+
+    int sentBefore = sent;
+    removeExpired();
+
+    while (elapsed.elapsed() < deadline)
+    {
+        Batch batch = takeBatch(hitsPerPost());
+        if (batch.isEmpty())
+        {
+            if (batch.throttleWait <= 0 || elapsed.elapsed() + batch.throttleWait > deadline)
+            {
+                break;
+            }
+
+            QThread::msleep(static_cast<unsigned long>(batch.throttleWait));
+            continue;
+        }
+
+        GAnalyticsBatchBody body(batch.messages, batch.sendTime);
+        QByteArray compressed;
+        QBuffer compressedBody(&compressed);
+        QByteArray contentEncoding;
+        QIODevice *content = &body;
+        if (compressBody(batch, &body, &compressed))
+        {
+            compressedBody.open(QIODevice::ReadOnly);
+            content = &compressedBody;
+            contentEncoding = "gzip";
+        }
+
+        QString errorString;
+        int httpStatus = transport->post(batch.url, content, contentEncoding, ua, &errorString);
+        if (finishBatch(batch, httpStatus, errorString) == PostRetryable)
+        {
+            break;
+        }
+    }
+
+    return sent - sentBefore;
+}
+
+int GAnalyticsCore::sentCount() const
+{
+    return sent;
+}
+
+int GAnalyticsCore::rejectedCount() const
+{
+    return rejected;
+}
+
+/**
+ * Size of the bodies which were compressed, before compression.
+ */
+qint64 GAnalyticsCore::compressedBodyBytes() const
+{
+    return bytesBeforeCompression;
+}
+
+/**
+ * Size of the bodies which were compressed, after compression.
+ */
+qint64 GAnalyticsCore::compressedWireBytes() const
+{
+    return bytesAfterCompression;
+}
+
+QList<GAnalyticsCore::DeadLetter> GAnalyticsCore::deadLetters() const
+{
+    return deadLetterQueue;
+}
+
+void GAnalyticsCore::clearDeadLetters()
+{
+    deadLetterQueue.clear();
+}
+
+/**
+ * Keep a message the collector refused for inspection.
+ * Only the latest maxDeadLetters messages are kept.
+ * @param message
+ * @param httpStatus    Status of the reply, 0 if the message was never sent.
+ * @param reason
+ */
+void GAnalyticsCore::addDeadLetter(const Message &message, int httpStatus, const QString &reason)
+{
+    logMessage(Error, QString("Message rejected: %1").arg(reason));
+
+    DeadLetter letter;
+    letter.message = QUrlQuery(QString::fromLatin1(message.query)).toString();
+    letter.httpStatus = httpStatus;
+    letter.reason = reason;
+    letter.time = anchor + message.time;
+
+    deadLetterQueue.enqueue(letter);
+    while (deadLetterQueue.count() > maxDeadLetters)
+    {
+        deadLetterQueue.dequeue();
+    }
+    ++rejected;
+}
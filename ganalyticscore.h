@@ -0,0 +1,312 @@
+#ifndef GANALYTICSCORE_H
+#define GANALYTICSCORE_H
+
+#include <QByteArray>
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QIODevice>
+#include <QList>
+#include <QQueue>
+#include <QString>
+#include <QUrl>
+#include <QUrlQuery>
+#include <QVariantMap>
+
+#include "ganalyticsbacklog.h"
+#include "ganalyticscompressor.h"
+#include "ganalyticscongestion.h"
+#include "ganalyticsthrottle.h"
+
+/**
+ * Monotonic time source of the dispatch logic in milliseconds.
+ * By default the core reads its own QElapsedTimer. A simulation
+ * installs a virtual clock before the first message is queued.
+ */
+class GAnalyticsClock
+{
+public:
+    virtual ~GAnalyticsClock() {}
+
+    virtual qint64 elapsed() const = 0;
+};
+
+/**
+ * Blocking transport for GAnalyticsCore::send(). Posts one request
+ * and returns once the collector answered or the request failed.
+ */
+class GAnalyticsTransport
+{
+public:
+    virtual ~GAnalyticsTransport() {}
+
+    /**
+     * @param url           The collect or batch endpoint.
+     * @param body          Url encoded messages, one per line. Open for reading, size() is the content length.
+     * @param contentEncoding   "gzip" if the body is compressed, otherwise empty.
+     * @param userAgent
+     * @param errorString   Set if the request failed.
+     * @return httpStatus   Status of the reply, 0 if the collector was not reached.
+     */
+    virtual int post(const QUrl &url, QIODevice *body, const QByteArray &contentEncoding,
+                     const QString &userAgent, QString *errorString) = 0;
+};
+
+/**
+ * Hit encoding, message queue, persistence and dispatch policy of the
+ * tracker. Plain C++ on top of QtCore: no QObject, no timers and no
+ * event loop, so it can be used from any thread that owns it.
+ * GAnalytics wraps it for applications with an event loop. Services
+ * without one queue messages here and call send() with their own
+ * transport from time to time.
+ */
+class GAnalyticsCore
+{
+public:
+    enum LogLevel
+    {
+        Debug,
+        Info,
+        Error,
+        None
+    };
+
+    enum Priority
+    {
+        Urgent,
+        Normal,
+        Bulk
+    };
+
+    enum PostResult
+    {
+        PostSucceeded,
+        PostRetryable,      ///< Network error or server side error, the messages are sent again later
+        PostRejected        ///< The collector refused the messages, retrying will not help
+    };
+
+    struct Message
+    {
+        QByteArray query;   ///< Fully encoded, without the queue time
+        qint64 time;        ///< Milliseconds on the monotonic clock of the core
+        Priority priority;
+        bool sendAlone;     ///< Part of a rejected batch, sent on its own to find the culprit
+    };
+
+    /**
+     * A message the collector refused permanently.
+     */
+    struct DeadLetter
+    {
+        QString message;
+        int httpStatus;
+        QString reason;
+        qint64 time;        ///< Wall clock time (UTC) the message was queued
+    };
+
+    /**
+     * Messages taken from the queue to be posted in one request.
+     */
+    struct Batch
+    {
+        QList<Message> messages;
+        QUrl url;
+        qint64 sendTime;        ///< The queue times of the messages are relative to it
+        int size;               ///< Length of the request body
+        bool full;              ///< Limited by the number of hits or bytes, not by the queue
+        qint64 throttleWait;    ///< > 0 if the throttle stopped the batch, time until the next token
+
+        bool isEmpty() const { return messages.isEmpty(); }
+    };
+
+    const static int fourHours = 4 * 60 * 60 * 1000;
+    const static int maxHitsPerBatch = 20;
+    const static int maxBytesPerBatch = 16 * 1024;
+    const static int maxBytesPerHit = 8 * 1024;
+    const static int maxDeadLetters = 100;
+    const static int messagesPerPage = 500;
+    const static int maxCachedScreenViews = 256;
+
+    GAnalyticsCore();
+
+    // Values sent with every message
+    void setTrackingID(const QString &trackingID);
+    QString trackingID() const;
+    void setClientID(const QString &clientID);
+    QString clientID() const;
+    void setUserID(const QString &userID);
+    QString userID() const;
+    void setAppName(const QString &appName);
+    QString appName() const;
+    void setAppVersion(const QString &appVersion);
+    QString appVersion() const;
+    void setLanguage(const QString &language);
+    QString language() const;
+    void setScreenResolution(const QString &screenResolution);
+    QString screenResolution() const;
+    void setViewportSize(const QString &viewportSize);
+    QString viewportSize() const;
+    void setUserAgent(const QString &userAgent);
+    QString userAgent() const;
+
+    void setLogLevel(LogLevel logLevel);
+    LogLevel logLevel() const;
+    void logMessage(LogLevel level, const QString &message) const;
+
+    void setClock(const GAnalyticsClock *clock);
+    qint64 now() const;
+    qint64 clockAnchor() const;
+    void setMaxMessageAge(qint64 milliseconds);
+    qint64 maxMessageAge() const;
+    void setRateLimit(int burst, double messagesPerSecond);
+    int rateLimitBurst() const;
+    double rateLimitPerSecond() const;
+    void setEndpoint(const QUrl &endpoint);
+    QUrl endpoint() const;
+    void setCompressionThreshold(int bytes);
+    int compressionThreshold() const;
+    void setAdaptiveDispatch(bool enabled);
+    bool adaptiveDispatch() const;
+    void setDispatchBounds(int minHits, int maxHits, int minPosts, int maxPosts);
+    const GAnalyticsCongestionControl &congestionControl() const;
+    int hitsPerPost() const;
+
+    // Hit encoding
+    QUrlQuery buildStandardPostQuery(const QString &type) const;
+    QUrlQuery buildScreenViewQuery(const QString &screenName) const;
+    QByteArray encodeScreenView(const QString &screenName) const;
+    QUrlQuery buildEventQuery(const QString &category, const QString &action,
+                              const QString &label = QString(), const QVariant &value = QVariant()) const;
+    QUrlQuery buildExceptionQuery(const QString &exceptionDescription, bool exceptionFatal) const;
+    QUrlQuery buildTimingQuery(const QString &category, const QString &variable,
+                               int milliseconds, const QString &label = QString()) const;
+    static void appendCustomValues(QUrlQuery &query, const QVariantMap &customValues);
+    static QByteArray queueTimeField(const Message &message, qint64 sendTime);
+
+    // Hit templates
+    int registerEventTemplate(const QString &category, const QString &action,
+                              const QVariantMap &customValues = QVariantMap());
+    QByteArray buildFromEventTemplate(int handle, const QString &label = QString(), const QVariant &value = QVariant(),
+                                      const QVariantMap &varyingValues = QVariantMap()) const;
+
+    // Queue
+    void enqueue(const QUrlQuery &query, Priority priority = Normal);
+    void enqueue(const QByteArray &encodedQuery, Priority priority = Normal);
+    void requeue(const QList<Message> &messages);
+    QList<Message> take(Priority priority);
+    QList<Message> messages() const;
+    int removeExpired();
+    void clear();
+    bool isEmpty() const;
+    int count() const;
+    int count(Priority priority) const;
+    int backlogCount() const;
+
+    // Persistence
+    QList<QString> persistMessages(const QList<Message> &messages) const;
+    void readMessages(const QList<QString> &dataList);
+    void writeMessages(QDataStream &outStream);
+    void readMessages(QDataStream &inStream);
+    void setCompressPersistedMessages(bool enabled);
+    bool compressPersistedMessages() const;
+    qint64 persistedBytes() const;
+    qint64 persistedMessageCount() const;
+
+    // Dispatch
+    Batch takeBatch(int maxHits = maxHitsPerBatch, bool urgentOnly = false);
+    bool compressBody(const Batch &batch, QIODevice *body, QByteArray *compressed);
+    PostResult finishBatch(const Batch &batch, int httpStatus, const QString &errorString);
+    int send(GAnalyticsTransport *transport, int deadline);
+
+    int sentCount() const;
+    int rejectedCount() const;
+    qint64 compressedBodyBytes() const;
+    qint64 compressedWireBytes() const;
+    QList<DeadLetter> deadLetters() const;
+    void clearDeadLetters();
+
+private:
+    /**
+     * Message queue with one lane per priority.
+     * The urgent lane is always drained first. Otherwise messages
+     * are taken from the most important lane, except that every
+     * maxBulkSkips-th message comes from the bulk lane so that
+     * replayed messages are not starved by a busy application.
+     */
+    class Queue
+    {
+    public:
+        Queue();
+
+        void enqueue(const Message &message);
+        void requeue(const Message &message);
+        Message dequeue();
+        Message dequeue(Priority priority);
+        int removeExpired(qint64 now, qint64 maxAge);
+        QList<Message> take(Priority priority);
+        QList<Message> toList() const;
+        void clear();
+
+        bool isEmpty() const;
+        int count() const;
+        int count(Priority priority) const;
+
+    private:
+        const static int laneCount = Bulk + 1;
+        const static int maxBulkSkips = 8;
+
+        QQueue<Message> lanes[laneCount];
+        int bulkSkips;
+    };
+
+    void refillFromBacklog();
+    const QByteArray &standardFields(const QString &type) const;
+    static QByteArray normalized(const QString &query);
+    static QByteArray queryItemValue(const QByteArray &encodedQuery, const QByteArray &key);
+    void addDeadLetter(const Message &message, int httpStatus, const QString &reason);
+
+    const static QString dateTimeFormat;
+    const static QString anchorPrefix;
+    const static int maxThrottledSkips = 200;  ///< Messages a batch skips at most for tracking ids without tokens
+
+    // Named after their parameters in the measurement protocol
+    QString tid;
+    QString cid;
+    QString uid;
+    QString an;
+    QString av;
+    QString ul;
+    QString sr;
+    QString vp;
+    QString ua;
+    LogLevel level;
+
+    mutable QHash<QString, QByteArray> standardFieldCache;  ///< Encoded standard fields per hit type
+    QList<QByteArray> templates;               ///< Encoded fixed fields per template handle
+    mutable QHash<QString, QByteArray> screenViewCache;    ///< Encoded screen view fields per screen name
+
+    QElapsedTimer clock;
+    const GAnalyticsClock *virtualClock;
+    qint64 anchor;
+    qint64 maxAge;
+
+    Queue queue;
+    GAnalyticsBacklog backlog;
+    GAnalyticsThrottle throttle;
+    QUrl collectUrl;
+    QUrl batchUrl;
+    GAnalyticsCompressor compressor;
+    GAnalyticsCongestionControl congestion;
+    bool adaptive;
+    int compressionMinimum;
+    qint64 bytesBeforeCompression;
+    qint64 bytesAfterCompression;
+    bool compressPages;
+    qint64 bytesPersisted;
+    qint64 messagesPersisted;
+    QQueue<DeadLetter> deadLetterQueue;
+    int sent;
+    int rejected;
+};
+
+#endif // GANALYTICSCORE_H
@@ -0,0 +1,194 @@
+#include "ganalyticshistogram.h"
+
+#include <QHash>
+#include <QtAlgorithms>
+
+#include <climits>
+
+GAnalyticsHistogram::GAnalyticsHistogram(const QString &category, const QString &variable, uint hash)
+: category(category)
+, variable(variable)
+, hash(hash)
+, maximum(0)
+{
+}
+
+/**
+ * Count a duration. Negative durations count as zero.
+ * @param milliseconds
+ */
+void GAnalyticsHistogram::record(int milliseconds)
+{
+    quint32 value = milliseconds > 0 ? quint32(milliseconds) : 0;
+    counts[bucketIndex(value)].fetchAndAddRelaxed(1);
+
+    int current = maximum.loadAcquire();
+    while (int(value) > current && !maximum.testAndSetRelaxed(current, int(value)))
+    {
+        current = maximum.loadAcquire();
+    }
+}
+
+/**
+ * Read and reset all counts.
+ * Values recorded meanwhile go either into this or into the next summary.
+ * @return summary      Count, percentiles and maximum since the last call.
+ */
+GAnalyticsHistogram::Summary GAnalyticsHistogram::takeSummary()
+{
+    int snapshot[bucketCount];
+    int total = 0;
+    for (int i = 0; i < bucketCount; ++i)
+    {
+        snapshot[i] = counts[i].fetchAndStoreRelaxed(0);
+        total += snapshot[i];
+    }
+
+    Summary summary;
+    summary.category = category;
+    summary.variable = variable;
+    summary.count = total;
+    summary.max = maximum.fetchAndStoreRelaxed(0);
+    summary.p50 = qMin(percentile(snapshot, total, 50), summary.max);
+    summary.p90 = qMin(percentile(snapshot, total, 90), summary.max);
+    summary.p99 = qMin(percentile(snapshot, total, 99), summary.max);
+
+    return summary;
+}
+
+int GAnalyticsHistogram::bucketIndex(quint32 value)
+{
+    if (value < quint32(subBucketCount))
+    {
+        return int(value);
+    }
+
+    int exponent = 31 - qCountLeadingZeroBits(value);
+    int shift = exponent - subBucketBits;
+    int subBucket = int(value >> shift) - subBucketCount;
+
+    return subBucketCount + shift * subBucketCount + subBucket;
+}
+
+/**
+ * Largest value counted in a bucket.
+ * @param index
+ * @return value
+ */
+int GAnalyticsHistogram::bucketUpperBound(int index)
+{
+    if (index < subBucketCount)
+    {
+        return index;
+    }
+
+    int shift = (index - subBucketCount) / subBucketCount;
+    qint64 subBucket = (index - subBucketCount) % subBucketCount;
+    qint64 upper = ((subBucketCount + subBucket + 1) << shift) - 1;
+
+    return int(qMin<qint64>(upper, INT_MAX));
+}
+
+/**
+ * @param counts
+ * @param total         Sum of all counts.
+ * @param percent
+ * @return value        Upper bound of the bucket holding the percentile, 0 if empty.
+ */
+int GAnalyticsHistogram::percentile(const int *counts, int total, int percent)
+{
+    if (total == 0)
+    {
+        return 0;
+    }
+
+    qint64 rank = (qint64(total) * percent + 99) / 100;
+    qint64 seen = 0;
+    for (int i = 0; i < bucketCount; ++i)
+    {
+        seen += counts[i];
+        if (seen >= rank)
+        {
+            return bucketUpperBound(i);
+        }
+    }
+
+    return bucketUpperBound(bucketCount - 1);
+}
+
+GAnalyticsHistogramTable::GAnalyticsHistogramTable()
+{
+}
+
+GAnalyticsHistogramTable::~GAnalyticsHistogramTable()
+{
+    for (int i = 0; i < capacity; ++i)
+    {
+        delete table[i].loadAcquire();
+    }
+}
+
+/**
+ * Count a duration in the histogram of its key.
+ * @param category
+ * @param variable
+ * @param milliseconds
+ * @return recorded     False if the table is full.
+ */
+bool GAnalyticsHistogramTable::record(const QString &category, const QString &variable, int milliseconds)
+{
+    uint hash = qHash(category) ^ (qHash(variable) * 31);
+
+    for (int probe = 0; probe < capacity; ++probe)
+    {
+        QAtomicPointer<GAnalyticsHistogram> &slot = table[(hash + probe) % capacity];
+        GAnalyticsHistogram *histogram = slot.loadAcquire();
+        if (histogram == NULL)
+        {
+            // First value of this key.
+            GAnalyticsHistogram *created = new GAnalyticsHistogram(category, variable, hash);
+            if (slot.testAndSetOrdered(NULL, created))
+            {
+                histogram = created;
+            }
+            else
+            {
+                delete created;
+                histogram = slot.loadAcquire();
+            }
+        }
+
+        if (histogram->hash == hash && histogram->category == category && histogram->variable == variable)
+        {
+            histogram->record(milliseconds);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Read and reset all histograms which received values.
+ * @return summaries
+ */
+QList<GAnalyticsHistogram::Summary> GAnalyticsHistogramTable::takeSummaries()
+{
+    QList<GAnalyticsHistogram::Summary> summaries;
+    for (int i = 0; i < capacity; ++i)
+    {
+        GAnalyticsHistogram *histogram = table[i].loadAcquire();
+        if (histogram == NULL)
+        {
+            continue;
+        }
+
+        GAnalyticsHistogram::Summary summary = histogram->takeSummary();
+        if (summary.count > 0)
+        {
+            summaries << summary;
+        }
+    }
+
+    return summaries;
+}
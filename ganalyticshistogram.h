@@ -0,0 +1,74 @@
+#ifndef GANALYTICSHISTOGRAM_H
+#define GANALYTICSHISTOGRAM_H
+
+#include <QAtomicInt>
+#include <QAtomicPointer>
+#include <QList>
+#include <QString>
+
+/**
+ * Log-linear histogram of durations in milliseconds.
+ * Values below 16 are counted exactly, larger values in 16 buckets
+ * per power of two, i.e. with a relative error below 6.25 %.
+ * Recording is lock-free and does not allocate.
+ */
+class GAnalyticsHistogram
+{
+public:
+    GAnalyticsHistogram(const QString &category, const QString &variable, uint hash);
+
+    struct Summary
+    {
+        QString category;
+        QString variable;
+        int count;
+        int p50;
+        int p90;
+        int p99;
+        int max;
+    };
+
+    void record(int milliseconds);
+    Summary takeSummary();
+
+    const QString category;
+    const QString variable;
+    const uint hash;
+
+private:
+    static int bucketIndex(quint32 value);
+    static int bucketUpperBound(int index);
+    static int percentile(const int *counts, int total, int percent);
+
+    const static int subBucketBits = 4;
+    const static int subBucketCount = 1 << subBucketBits;
+    const static int bucketCount = subBucketCount + (32 - subBucketBits) * subBucketCount;
+
+    QAtomicInt counts[bucketCount];
+    QAtomicInt maximum;
+};
+
+/**
+ * Fixed size table of histograms keyed by category and variable.
+ * The first value of a key allocates its histogram once, all further
+ * values are recorded without locks and allocations. The table can
+ * be used from any thread; takeSummaries() from one thread at a time.
+ */
+class GAnalyticsHistogramTable
+{
+public:
+    GAnalyticsHistogramTable();
+    ~GAnalyticsHistogramTable();
+
+    bool record(const QString &category, const QString &variable, int milliseconds);
+    QList<GAnalyticsHistogram::Summary> takeSummaries();
+
+private:
+    Q_DISABLE_COPY(GAnalyticsHistogramTable)
+
+    const static int capacity = 64;
+
+    QAtomicPointer<GAnalyticsHistogram> table[capacity];
+};
+
+#endif // GANALYTICSHISTOGRAM_H
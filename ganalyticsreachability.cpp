@@ -0,0 +1,97 @@
+#include "ganalyticsreachability.h"
+
+#if (QT_VERSION >= QT_VERSION_CHECK(6, 1, 0))
+#include <QNetworkInformation>
+#elif (QT_VERSION < QT_VERSION_CHECK(6, 0, 0))
+#include <QNetworkConfiguration>
+#include <QNetworkConfigurationManager>
+#endif
+
+GAnalyticsReachability::GAnalyticsReachability(QObject *parent)
+: QObject(parent)
+{
+}
+
+/**
+ * Constructor
+ * Loads the platform's reachability backend and follows its changes.
+ * @param parent
+ */
+GAnalyticsSystemReachability::GAnalyticsSystemReachability(QObject *parent)
+: GAnalyticsReachability(parent)
+, online(true)
+{
+#if (QT_VERSION >= QT_VERSION_CHECK(6, 1, 0))
+    if (QNetworkInformation::load(QNetworkInformation::Feature::Reachability))
+    {
+        connect(QNetworkInformation::instance(), &QNetworkInformation::reachabilityChanged,
+                this, &GAnalyticsSystemReachability::update);
+    }
+#elif (QT_VERSION < QT_VERSION_CHECK(6, 0, 0))
+    // Deprecated in 5.15 without a replacement before Qt 6.1.
+    QT_WARNING_PUSH
+    QT_WARNING_DISABLE_DEPRECATED
+    QNetworkConfigurationManager *manager = new QNetworkConfigurationManager(this);
+    connect(manager, SIGNAL(onlineStateChanged(bool)), this, SLOT(update()));
+    QT_WARNING_POP
+#endif
+    update();
+}
+
+bool GAnalyticsSystemReachability::isOnline() const
+{
+    return online;
+}
+
+/**
+ * Ask the backend for the current state. Unknown states count as online,
+ * so a backend which cannot tell does not stop the tracker.
+ */
+void GAnalyticsSystemReachability::update()
+{
+    bool isOnline = true;
+#if (QT_VERSION >= QT_VERSION_CHECK(6, 1, 0))
+    QNetworkInformation *information = QNetworkInformation::instance();
+    if (information)
+    {
+        isOnline = information->reachability() != QNetworkInformation::Reachability::Disconnected;
+    }
+#elif (QT_VERSION < QT_VERSION_CHECK(6, 0, 0))
+    QT_WARNING_PUSH
+    QT_WARNING_DISABLE_DEPRECATED
+    QNetworkConfigurationManager *manager = findChild<QNetworkConfigurationManager*>();
+    // Without a bearer plugin no configuration is ever discovered and
+    // isOnline() is false for good, e.g. in minimal containers.
+    if (manager && !manager->allConfigurations(QNetworkConfiguration::Discovered).isEmpty())
+    {
+        isOnline = manager->isOnline();
+    }
+    QT_WARNING_POP
+#endif
+
+    if (online != isOnline)
+    {
+        online = isOnline;
+        emit onlineChanged(online);
+    }
+}
+
+GAnalyticsManualReachability::GAnalyticsManualReachability(QObject *parent)
+: GAnalyticsReachability(parent)
+, online(true)
+{
+}
+
+bool GAnalyticsManualReachability::isOnline() const
+{
+    return online;
+}
+
+void GAnalyticsManualReachability::setOnline(bool online)
+{
+    if (this->online != online)
+    {
+        this->online = online;
+        emit onlineChanged(online);
+    }
+}
@@ -0,0 +1,64 @@
+#ifndef GANALYTICSREACHABILITY_H
+#define GANALYTICSREACHABILITY_H
+
+#include <QObject>
+
+/**
+ * Tells the tracker whether the collector can be reached.
+ * While offline, the tracker does not try to send.
+ */
+class GAnalyticsReachability : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit GAnalyticsReachability(QObject *parent = 0);
+
+    virtual bool isOnline() const = 0;
+
+signals:
+    void onlineChanged(bool online);
+};
+
+/**
+ * Default probe. Uses QNetworkInformation on Qt 6.1 and later and
+ * QNetworkConfigurationManager on Qt 5. Reports online if the
+ * platform cannot tell, e.g. if no bearer plugin finds an interface.
+ */
+class GAnalyticsSystemReachability : public GAnalyticsReachability
+{
+    Q_OBJECT
+
+public:
+    explicit GAnalyticsSystemReachability(QObject *parent = 0);
+
+    bool isOnline() const;
+
+private slots:
+    void update();
+
+private:
+    bool online;
+};
+
+/**
+ * Probe controlled by the application, e.g. if it monitors the
+ * connection to its own relay. Starts online.
+ */
+class GAnalyticsManualReachability : public GAnalyticsReachability
+{
+    Q_OBJECT
+
+public:
+    explicit GAnalyticsManualReachability(QObject *parent = 0);
+
+    bool isOnline() const;
+
+public slots:
+    void setOnline(bool online);
+
+private:
+    bool online;
+};
+
+#endif // GANALYTICSREACHABILITY_H
@@ -0,0 +1,203 @@
+#include "ganalyticssettings.h"
+
+#include <QRunnable>
+#include <QSettings>
+#include <QStringList>
+
+static const QString keyPrefix = "GAnalytics-";
+
+/**
+ * Hands a set of changes to the store on the writer thread.
+ */
+class SettingsWriteJob : public QRunnable
+{
+public:
+    SettingsWriteJob(GAnalyticsSettingsStore *store, const QVariantMap &changes)
+    : store(store)
+    , changes(changes)
+    {
+    }
+
+    void run()
+    {
+        store->save(changes);
+    }
+
+private:
+    GAnalyticsSettingsStore *store;
+    QVariantMap changes;
+};
+
+/**
+ * Read all tracker values from the application settings.
+ * Only keys owned by the tracker are loaded.
+ * @return values       The tracker values.
+ */
+QVariantMap GAnalyticsQSettingsStore::load()
+{
+    QSettings settings;
+    QVariantMap values;
+    foreach (const QString &key, settings.allKeys())
+    {
+        if (key.startsWith(keyPrefix))
+        {
+            values.insert(key, settings.value(key));
+        }
+    }
+
+    return values;
+}
+
+/**
+ * Write changed tracker values to the application settings.
+ * @param changes       Changed values. Invalid values are removed.
+ */
+void GAnalyticsQSettingsStore::save(const QVariantMap &changes)
+{
+    QSettings settings;
+    for (QVariantMap::const_iterator iter = changes.begin(); iter != changes.end(); ++iter)
+    {
+        if (iter.value().isValid())
+        {
+            settings.setValue(iter.key(), iter.value());
+        }
+        else
+        {
+            settings.remove(iter.key());
+        }
+    }
+}
+
+/**
+ * Constructor
+ * Loads the values from the default QSettings based store.
+ * @param parent
+ */
+GAnalyticsSettings::GAnalyticsSettings(QObject *parent)
+: QObject(parent)
+, backingStore(NULL)
+{
+    writer.setMaxThreadCount(1);
+    writeTimer.setSingleShot(true);
+    writeTimer.setInterval(1000);
+    connect(&writeTimer, SIGNAL(timeout()), this, SLOT(writePending()));
+
+    setStore(new GAnalyticsQSettingsStore);
+}
+
+/**
+ * Destructor
+ * Pending changes are written before the store is deleted.
+ */
+GAnalyticsSettings::~GAnalyticsSettings()
+{
+    sync();
+    delete backingStore;
+}
+
+/**
+ * Replace the backing store. Pending changes go to the old store,
+ * afterwards all values are reloaded from the new one.
+ * @param store         The new store. Ownership is taken.
+ */
+void GAnalyticsSettings::setStore(GAnalyticsSettingsStore *store)
+{
+    if (store == backingStore)
+    {
+        return;
+    }
+
+    sync();
+    delete backingStore;
+
+    backingStore = store;
+    values = backingStore ? backingStore->load() : QVariantMap();
+}
+
+GAnalyticsSettingsStore *GAnalyticsSettings::store() const
+{
+    return backingStore;
+}
+
+void GAnalyticsSettings::setWriteDelay(int milliseconds)
+{
+    writeTimer.setInterval(milliseconds);
+}
+
+int GAnalyticsSettings::writeDelay() const
+{
+    return writeTimer.interval();
+}
+
+bool GAnalyticsSettings::contains(const QString &key) const
+{
+    return values.contains(key);
+}
+
+QVariant GAnalyticsSettings::value(const QString &key, const QVariant &defaultValue) const
+{
+    return values.value(key, defaultValue);
+}
+
+void GAnalyticsSettings::setValue(const QString &key, const QVariant &value)
+{
+    values.insert(key, value);
+    pending.insert(key, value);
+    scheduleWrite();
+}
+
+void GAnalyticsSettings::remove(const QString &key)
+{
+    if (values.remove(key) == 0)
+    {
+        return;
+    }
+
+    pending.insert(key, QVariant());
+    scheduleWrite();
+}
+
+/**
+ * Hand pending changes to the store and block until they are written.
+ */
+void GAnalyticsSettings::sync()
+{
+    writePending();
+    writer.waitForDone();
+}
+
+/**
+ * (Re)start the write delay. A burst of changes is written together,
+ * but never later than five delays after the first pending change.
+ */
+void GAnalyticsSettings::scheduleWrite()
+{
+    if (!pendingSince.isValid())
+    {
+        pendingSince.start();
+    }
+    else if (pendingSince.elapsed() > 5 * writeTimer.interval())
+    {
+        return;
+    }
+
+    writeTimer.start();
+}
+
+/**
+ * Pass all pending changes to the writer thread.
+ */
+void GAnalyticsSettings::writePending()
+{
+    writeTimer.stop();
+    pendingSince.invalidate();
+
+    if (pending.isEmpty() || !backingStore)
+    {
+        pending.clear();
+        return;
+    }
+
+    writer.start(new SettingsWriteJob(backingStore, pending));
+    pending.clear();
+}
@@ -0,0 +1,78 @@
+#ifndef GANALYTICSSETTINGS_H
+#define GANALYTICSSETTINGS_H
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QThreadPool>
+#include <QTimer>
+#include <QVariantMap>
+
+/**
+ * Backing store for the values the tracker persists (client id, user id, ...).
+ * load() is called on the thread owning the tracker. save() is called on a
+ * background thread with the values changed since the last save; an invalid
+ * QVariant means the key was removed. Calls are never made concurrently.
+ */
+class GAnalyticsSettingsStore
+{
+public:
+    virtual ~GAnalyticsSettingsStore() {}
+
+    virtual QVariantMap load() = 0;
+    virtual void save(const QVariantMap &changes) = 0;
+};
+
+/**
+ * Default store. Keeps the values in the application's QSettings.
+ */
+class GAnalyticsQSettingsStore : public GAnalyticsSettingsStore
+{
+public:
+    QVariantMap load();
+    void save(const QVariantMap &changes);
+};
+
+/**
+ * In-memory view of the persisted tracker values.
+ * Reads are served from memory. Writes are collected and handed to the
+ * store on a background thread once no further write arrived for
+ * writeDelay() milliseconds.
+ */
+class GAnalyticsSettings : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit GAnalyticsSettings(QObject *parent = 0);
+    ~GAnalyticsSettings();
+
+    /// Replace the backing store and reload all values from it. Takes ownership.
+    void setStore(GAnalyticsSettingsStore *store);
+    GAnalyticsSettingsStore *store() const;
+
+    void setWriteDelay(int milliseconds);
+    int writeDelay() const;
+
+    bool contains(const QString &key) const;
+    QVariant value(const QString &key, const QVariant &defaultValue = QVariant()) const;
+    void setValue(const QString &key, const QVariant &value);
+    void remove(const QString &key);
+
+    /// Write all pending changes and wait until the store has saved them.
+    void sync();
+
+private slots:
+    void writePending();
+
+private:
+    void scheduleWrite();
+
+    GAnalyticsSettingsStore *backingStore;
+    QVariantMap values;
+    QVariantMap pending;
+    QTimer writeTimer;
+    QElapsedTimer pendingSince;
+    QThreadPool writer;
+};
+
+#endif // GANALYTICSSETTINGS_H
@@ -0,0 +1,105 @@
+#include "ganalyticsspool.h"
+
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+#include <QStringList>
+#include <QUuid>
+
+static const QString fileSuffix = ".hits";
+
+/**
+ * Constructor
+ * Creates the directory if necessary.
+ * @param directory
+ */
+GAnalyticsSharedSpool::GAnalyticsSharedSpool(const QString &directory)
+: path(directory)
+, lock(directory + "/sender.lock")
+{
+    QDir().mkpath(path);
+
+    // The sender holds the lock as long as it runs. It only becomes
+    // stale when the process holding it is gone.
+    lock.setStaleLockTime(0);
+}
+
+QString GAnalyticsSharedSpool::directory() const
+{
+    return path;
+}
+
+bool GAnalyticsSharedSpool::isSender() const
+{
+    return lock.isLocked();
+}
+
+/**
+ * Try to take the lock without waiting.
+ * @return isSender
+ */
+bool GAnalyticsSharedSpool::tryBecomeSender()
+{
+    if (lock.isLocked())
+    {
+        return true;
+    }
+
+    return lock.tryLock(0);
+}
+
+/**
+ * Write records into a new file. Readers only see the file
+ * once it is complete.
+ * @param records       Persisted messages as written by GAnalytics.
+ * @return success
+ */
+bool GAnalyticsSharedSpool::write(const QList<QString> &records)
+{
+    QSaveFile file(path + "/" + QString::fromLatin1(QUuid::createUuid().toRfc4122().toHex()) + fileSuffix);
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        return false;
+    }
+
+    QDataStream outStream(&file);
+    outStream.setVersion(QDataStream::Qt_5_0);
+    outStream << records;
+
+    return file.commit();
+}
+
+/**
+ * Read and remove the oldest files of all processes.
+ * @param maxFiles
+ * @return files        The records of each file.
+ */
+QList<QList<QString> > GAnalyticsSharedSpool::takeFiles(int maxFiles)
+{
+    QList<QList<QString> > files;
+
+    QDir dir(path);
+    QFileInfoList entries = dir.entryInfoList(QStringList() << "*" + fileSuffix, QDir::Files, QDir::Time | QDir::Reversed);
+    for (int i = 0; i < entries.count() && i < maxFiles; ++i)
+    {
+        QFile file(entries.at(i).filePath());
+        if (!file.open(QIODevice::ReadOnly))
+        {
+            continue;
+        }
+
+        QDataStream inStream(&file);
+        inStream.setVersion(QDataStream::Qt_5_0);
+        QList<QString> records;
+        inStream >> records;
+        if (inStream.status() == QDataStream::Ok)
+        {
+            files.append(records);
+        }
+
+        file.remove();
+    }
+
+    return files;
+}
@@ -0,0 +1,35 @@
+#ifndef GANALYTICSSPOOL_H
+#define GANALYTICSSPOOL_H
+
+#include <QList>
+#include <QLockFile>
+#include <QString>
+
+/**
+ * Machine-local directory shared by several processes of an application.
+ * Every process writes its messages into files in the directory. The
+ * process holding the lock file is the sender: it collects the files of
+ * all processes and uploads their messages. If the sender dies, its lock
+ * becomes stale and the next process trying to lock takes over.
+ */
+class GAnalyticsSharedSpool
+{
+public:
+    explicit GAnalyticsSharedSpool(const QString &directory);
+
+    QString directory() const;
+
+    bool isSender() const;
+    bool tryBecomeSender();
+
+    bool write(const QList<QString> &records);
+    QList<QList<QString> > takeFiles(int maxFiles);
+
+private:
+    Q_DISABLE_COPY(GAnalyticsSharedSpool)
+
+    QString path;
+    QLockFile lock;
+};
+
+#endif // GANALYTICSSPOOL_H
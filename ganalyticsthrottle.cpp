@@ -0,0 +1,123 @@
+#include "ganalyticsthrottle.h"
+
+#include <qmath.h>
+
+GAnalyticsThrottle::GAnalyticsThrottle()
+: burstSize(0)
+, tokensPerMillisecond(0)
+{
+}
+
+/**
+ * Change the rate. All buckets start full again. A bucket that never
+ * refills would hold messages forever, so a rate of 0 disables
+ * throttling like a burst of 0 does.
+ * @param burst             Maximum number of tokens, 0 disables throttling.
+ * @param tokensPerSecond   Refill rate, 0 disables throttling.
+ */
+void GAnalyticsThrottle::setRate(int burst, double tokensPerSecond)
+{
+    burstSize = qMax(0, burst);
+    tokensPerMillisecond = qMax(0.0, tokensPerSecond) / 1000.0;
+    buckets.clear();
+}
+
+int GAnalyticsThrottle::burst() const
+{
+    return burstSize;
+}
+
+double GAnalyticsThrottle::tokensPerSecond() const
+{
+    return tokensPerMillisecond * 1000.0;
+}
+
+bool GAnalyticsThrottle::isEnabled() const
+{
+    return burstSize > 0 && tokensPerMillisecond > 0;
+}
+
+/**
+ * Take a token if one is available.
+ * @param trackingID
+ * @param now
+ * @return taken
+ */
+bool GAnalyticsThrottle::tryTake(const QString &trackingID, qint64 now)
+{
+    if (!isEnabled())
+    {
+        return true;
+    }
+
+    Bucket &bucket = refilled(trackingID, now);
+    if (bucket.tokens < 1.0)
+    {
+        return false;
+    }
+
+    bucket.tokens -= 1.0;
+    return true;
+}
+
+/**
+ * Take a token even if none is available. The bucket goes into
+ * debt, which delays the following messages.
+ * @param trackingID
+ * @param now
+ */
+void GAnalyticsThrottle::take(const QString &trackingID, qint64 now)
+{
+    if (isEnabled())
+    {
+        refilled(trackingID, now).tokens -= 1.0;
+    }
+}
+
+/**
+ * @param trackingID
+ * @param now
+ * @return milliseconds     Time until the next token is available.
+ */
+qint64 GAnalyticsThrottle::waitTime(const QString &trackingID, qint64 now)
+{
+    if (!isEnabled())
+    {
+        return 0;
+    }
+
+    Bucket &bucket = refilled(trackingID, now);
+    if (bucket.tokens >= 1.0)
+    {
+        return 0;
+    }
+
+    return qint64(qCeil((1.0 - bucket.tokens) / tokensPerMillisecond));
+}
+
+/**
+ * Get a bucket, created full, after adding the tokens since its last update.
+ * @param trackingID
+ * @param now
+ * @return bucket
+ */
+GAnalyticsThrottle::Bucket &GAnalyticsThrottle::refilled(const QString &trackingID, qint64 now)
+{
+    QHash<QString, Bucket>::iterator iter = buckets.find(trackingID);
+    if (iter == buckets.end())
+    {
+        Bucket bucket;
+        bucket.tokens = burstSize;
+        bucket.updated = now;
+        return buckets.insert(trackingID, bucket).value();
+    }
+
+    Bucket &bucket = iter.value();
+    if (now > bucket.updated)
+    {
+        bucket.tokens = qMin(double(burstSize), bucket.tokens + (now - bucket.updated) * tokensPerMillisecond);
+        bucket.updated = now;
+    }
+
+    return bucket;
+}
@@ -0,0 +1,41 @@
+#ifndef GANALYTICSTHROTTLE_H
+#define GANALYTICSTHROTTLE_H
+
+#include <QHash>
+#include <QString>
+
+/**
+ * Token bucket per tracking id, mirroring the collector's rate limits.
+ * Every message takes a token. The bucket holds up to burst tokens and
+ * refills at a constant rate. Times are milliseconds on any monotonic
+ * clock, so the throttle can be driven by a simulated clock as well.
+ */
+class GAnalyticsThrottle
+{
+public:
+    GAnalyticsThrottle();
+
+    void setRate(int burst, double tokensPerSecond);
+    int burst() const;
+    double tokensPerSecond() const;
+    bool isEnabled() const;
+
+    bool tryTake(const QString &trackingID, qint64 now);
+    void take(const QString &trackingID, qint64 now);
+    qint64 waitTime(const QString &trackingID, qint64 now);
+
+private:
+    struct Bucket
+    {
+        double tokens;
+        qint64 updated;
+    };
+
+    Bucket &refilled(const QString &trackingID, qint64 now);
+
+    QHash<QString, Bucket> buckets;
+    int burstSize;
+    double tokensPerMillisecond;
+};
+
+#endif // GANALYTICSTHROTTLE_H
@@ -0,0 +1,158 @@
+#include "ganalyticstrace.h"
+
+#include <QAtomicInt>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QThread>
+
+#ifdef GANALYTICS_TRACE
+#include <atomic>
+
+namespace {
+
+/**
+ * A slot of the ring. Readers may copy the fields while a writer
+ * changes them, so they are atomics too, accessed relaxed; the
+ * sequence tells whether the copy is consistent.
+ */
+struct Span
+{
+    QAtomicInt sequence;    ///< Number of the span written last, from 1, 0 while being written
+    std::atomic<const char *> name;
+    std::atomic<qint64> start;
+    std::atomic<qint64> duration;
+    std::atomic<quintptr> thread;
+};
+
+Span ring[GAnalyticsTrace::capacity];
+QAtomicInteger<quint32> written;
+
+/**
+ * Monotonic clock shared by all threads. Its reference is the
+ * system's monotonic clock, so timestamps line up with other
+ * traces taken on the same machine.
+ */
+const QElapsedTimer &traceClock()
+{
+    static QElapsedTimer clock;
+    static bool started = (clock.start(), true);
+    Q_UNUSED(started);
+
+    return clock;
+}
+
+QByteArray escaped(const char *name)
+{
+    QByteArray text(name);
+    text.replace('\\', "\\\\");
+    text.replace('"', "\\\"");
+    return text;
+}
+
+} // namespace
+
+#endif // GANALYTICS_TRACE
+
+/**
+ * Current time of the trace clock in microseconds.
+ */
+qint64 GAnalyticsTrace::timestamp()
+{
+#ifdef GANALYTICS_TRACE
+    const QElapsedTimer &clock = traceClock();
+    return clock.msecsSinceReference() * 1000 + clock.nsecsElapsed() / 1000;
+#else
+    return 0;
+#endif // GANALYTICS_TRACE
+}
+
+/**
+ * Add a span to the ring. Callable from any thread.
+ * @param name          A string literal.
+ * @param start         Microseconds on the trace clock.
+ * @param end
+ */
+void GAnalyticsTrace::record(const char *name, qint64 start, qint64 end)
+{
+#ifdef GANALYTICS_TRACE
+    quint32 number = written.fetchAndAddRelaxed(1);
+    Span &span = ring[number % capacity];
+
+    // Readers must see the slot invalidated before any field changes
+    span.sequence.storeRelease(0);
+    std::atomic_thread_fence(std::memory_order_release);
+    span.name.store(name, std::memory_order_relaxed);
+    span.start.store(start, std::memory_order_relaxed);
+    span.duration.store(end - start, std::memory_order_relaxed);
+    span.thread.store(quintptr(QThread::currentThreadId()), std::memory_order_relaxed);
+    // Never 0, also once the counter wrapped
+    span.sequence.storeRelease(int(number % 0x7fffffff) + 1);
+#else
+    Q_UNUSED(name);
+    Q_UNUSED(start);
+    Q_UNUSED(end);
+#endif // GANALYTICS_TRACE
+}
+
+/**
+ * The recorded spans as a Chrome trace JSON object. Spans which
+ * are being overwritten while exporting are left out.
+ * @return json         {"traceEvents": [...]}
+ */
+QByteArray GAnalyticsTrace::exportChromeTrace()
+{
+    QByteArray json = "{\"traceEvents\":[";
+
+#ifdef GANALYTICS_TRACE
+    QByteArray pid = QByteArray::number(QCoreApplication::applicationPid());
+    bool first = true;
+    for (int i = 0; i < capacity; ++i)
+    {
+        Span &span = ring[i];
+        int sequence = span.sequence.loadAcquire();
+        if (sequence == 0)
+        {
+            continue;
+        }
+
+        const char *name = span.name.load(std::memory_order_relaxed);
+        qint64 start = span.start.load(std::memory_order_relaxed);
+        qint64 duration = span.duration.load(std::memory_order_relaxed);
+        quintptr thread = span.thread.load(std::memory_order_relaxed);
+
+        // Skip the span if a writer reused the slot meanwhile. The fence keeps
+        // the reads of the fields above before the second read of the sequence.
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (span.sequence.loadAcquire() != sequence)
+        {
+            continue;
+        }
+
+        QByteArray event = "{\"name\":\"" + escaped(name) + "\",\"cat\":\"ganalytics\",\"ph\":\"X\""
+                           ",\"ts\":" + QByteArray::number(start)
+                           + ",\"dur\":" + QByteArray::number(duration)
+                           + ",\"pid\":" + pid
+                           + ",\"tid\":" + QByteArray::number(quint64(thread)) + "}";
+
+        if (!first)
+        {
+            json += ',';
+        }
+        json += event;
+        first = false;
+    }
+#endif // GANALYTICS_TRACE
+
+    json += "]}";
+    return json;
+}
+
+void GAnalyticsTrace::clear()
+{
+#ifdef GANALYTICS_TRACE
+    for (int i = 0; i < capacity; ++i)
+    {
+        ring[i].sequence.storeRelease(0);
+    }
+#endif // GANALYTICS_TRACE
+}
@@ -0,0 +1,65 @@
+#ifndef GANALYTICSTRACE_H
+#define GANALYTICSTRACE_H
+
+#include <QByteArray>
+#include <QtGlobal>
+
+/**
+ * Spans of the tracker's pipeline stages, kept in a fixed ring in memory
+ * and exported in the Chrome trace event format, which chrome://tracing
+ * and Perfetto load next to the application's own traces.
+ * Only compiled in with CONFIG += ganalytics_trace (GANALYTICS_TRACE).
+ * Otherwise GANALYTICS_TRACE_SPAN expands to nothing and the export
+ * is empty.
+ *
+ * Recording is lock-free: a writer claims a slot with one atomic add
+ * and publishes it with a sequence number. The oldest spans are
+ * overwritten once the ring is full.
+ */
+class GAnalyticsTrace
+{
+public:
+    const static int capacity = 4096;
+
+    static qint64 timestamp();
+    static void record(const char *name, qint64 start, qint64 end);
+    static QByteArray exportChromeTrace();
+    static void clear();
+};
+
+#ifdef GANALYTICS_TRACE
+
+/**
+ * Records the time until it goes out of scope as a span.
+ * The name must be a string literal.
+ */
+class GAnalyticsTraceSpan
+{
+public:
+    explicit GAnalyticsTraceSpan(const char *name)
+    : name(name)
+    , start(GAnalyticsTrace::timestamp())
+    {
+    }
+
+    ~GAnalyticsTraceSpan()
+    {
+        GAnalyticsTrace::record(name, start, GAnalyticsTrace::timestamp());
+    }
+
+private:
+    Q_DISABLE_COPY(GAnalyticsTraceSpan)
+
+    const char *name;
+    qint64 start;
+};
+
+#define GANALYTICS_TRACE_SPAN(name) GAnalyticsTraceSpan ganalyticsTraceSpan(name)
+
+#else
+
+#define GANALYTICS_TRACE_SPAN(name)
+
+#endif // GANALYTICS_TRACE
+
+#endif // GANALYTICSTRACE_H
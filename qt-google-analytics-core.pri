@@ -0,0 +1,27 @@
+INCLUDEPATH += $$PWD
+HEADERS += $$PWD/ganalyticscore.h \
+    $$PWD/ganalyticsbacklog.h \
+    $$PWD/ganalyticsbatchbody.h \
+    $$PWD/ganalyticscompressor.h \
+    $$PWD/ganalyticscongestion.h \
+    $$PWD/ganalyticsthrottle.h \
+    $$PWD/ganalyticstrace.h
+SOURCES += $$PWD/ganalyticscore.cpp \
+    $$PWD/ganalyticsbacklog.cpp \
+    $$PWD/ganalyticsbatchbody.cpp \
+    $$PWD/ganalyticscompressor.cpp \
+    $$PWD/ganalyticscongestion.cpp \
+    $$PWD/ganalyticsthrottle.cpp \
+    $$PWD/ganalyticstrace.cpp
+
+# Gzip request bodies for endpoints which accept them, see GAnalytics::setCompressionThreshold()
+ganalytics_gzip {
+    DEFINES += GANALYTICS_GZIP
+    LIBS += -lz
+}
+
+# Trace spans of the pipeline stages, see GAnalyticsTrace
+ganalytics_trace {
+    DEFINES += GANALYTICS_TRACE
+    CONFIG += c++11
+}
@@ -0,0 +1,8 @@
+TEMPLATE = lib
+CONFIG += staticlib
+
+QT = core
+
+include(qt-google-analytics-core.pri)
+
+OTHER_FILES += qt-google-analytics-core.pri
@@ -1,3 +1,18 @@
-INCLUDEPATH += $$PWD
-HEADERS += $$PWD/ganalytics.h
-SOURCES += $$PWD/ganalytics.cpp
+include($$PWD/qt-google-analytics-core.pri)
+
+HEADERS += $$PWD/ganalytics.h \
+    $$PWD/ganalytics_p.h \
+    $$PWD/ganalyticshistogram.h \
+    $$PWD/ganalyticsreachability.h \
+    $$PWD/ganalyticssettings.h \
+    $$PWD/ganalyticsspool.h
+SOURCES += $$PWD/ganalytics.cpp \
+    $$PWD/ganalyticshistogram.cpp \
+    $$PWD/ganalyticsreachability.cpp \
+    $$PWD/ganalyticssettings.cpp \
+    $$PWD/ganalyticsspool.cpp
+
+contains(QT, qml) {
+    HEADERS += $$PWD/ganalyticsattached.h
+    SOURCES += $$PWD/ganalyticsattached.cpp
+}